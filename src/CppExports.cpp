@@ -22,6 +22,11 @@
 #include <signal.h>
 #include "RStuff/RUtil.h"
 #include "RStudioApi.h"
+#include "DataFrame.h"
+#include "EnvironmentSnapshot.h"
+#include "EventLoop.h"
+#include "ObjectSize.h"
+#include "ValueInfoCache.h"
 
 #define CppExport extern "C" attribute_visible
 
@@ -109,6 +114,88 @@ CppExport SEXP _jetbrains_View(SEXP expr, SEXP env, SEXP title) {
   CPP_END
 }
 
+CppExport SEXP _jetbrains_dataFrameColumnStats(SEXP x) {
+  CPP_BEGIN
+    return getDataFrameColumnStats(x);
+  CPP_END
+}
+
+// Names are upper bounds of the buckets in microseconds
+static SEXP latencyCounts(std::vector<LatencyHistogram const*> const& histograms) {
+  ShieldSEXP result = Rf_allocVector(REALSXP, LatencyHistogram::BUCKETS);
+  ShieldSEXP names = Rf_allocVector(STRSXP, LatencyHistogram::BUCKETS);
+  for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+    long long count = 0;
+    for (auto histogram : histograms) count += histogram->count(i);
+    REAL(result)[i] = (double)count;
+    std::string name = i == LatencyHistogram::BUCKETS - 1 ? "Inf" : std::to_string(1LL << i);
+    SET_STRING_ELT(names, i, Rf_mkChar(name.c_str()));
+  }
+  Rf_setAttrib(result, R_NamesSymbol, names);
+  return result;
+}
+
+CppExport SEXP _jetbrains_environmentDiff(SEXP env, SEXP token, SEXP allNames) {
+  CPP_BEGIN
+    return environmentDiff(env, asIntOrError(token), asBoolOrError(allNames));
+  CPP_END
+}
+
+CppExport SEXP _jetbrains_objectSize(SEXP x, SEXP timeLimitMs) {
+  CPP_BEGIN
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(asIntOrError(timeLimitMs));
+    ObjectSize size = getObjectSize(x, deadline);
+    const char* names[] = {"bytes", "isComplete", ""};
+    ShieldSEXP result = Rf_mkNamed(VECSXP, names);
+    SET_VECTOR_ELT(result, 0, Rf_ScalarReal((double)size.bytes));
+    SET_VECTOR_ELT(result, 1, Rf_ScalarLogical(size.isComplete));
+    return result;
+  CPP_END
+}
+
+// Counts of executeOnMainThread latencies
+CppExport SEXP _jetbrains_mainThreadLatency() {
+  CPP_BEGIN
+    return latencyCounts({&rpiService->mainThreadLatency});
+  CPP_END
+}
+
+// Per priority class: counts of event loop queue wait times and the number of dropped tasks
+CppExport SEXP _jetbrains_eventLoopStats() {
+  CPP_BEGIN
+    const char* names[] = {"interactive", "ui", "background", ""};
+    ShieldSEXP result = Rf_mkNamed(VECSXP, names);
+    for (int i = 0; i < TASK_PRIORITY_COUNT; ++i) {
+      TaskPriority priority = (TaskPriority)i;
+      TaskScheduler const& queue = getEventLoopScheduler(false);
+      TaskScheduler const& immediateQueue = getEventLoopScheduler(true);
+      ShieldSEXP waitTimes = latencyCounts({&queue.getWaitTimes(priority), &immediateQueue.getWaitTimes(priority)});
+      double dropped = (double)(queue.getDroppedCount(priority) + immediateQueue.getDroppedCount(priority));
+      const char* statNames[] = {"waitTimes", "dropped", ""};
+      ShieldSEXP stats = Rf_mkNamed(VECSXP, statNames);
+      SET_VECTOR_ELT(stats, 0, waitTimes);
+      SET_VECTOR_ELT(stats, 1, Rf_ScalarReal(dropped));
+      SET_VECTOR_ELT(result, i, stats);
+    }
+    return result;
+  CPP_END
+}
+
+// Hits and misses of the variables view cache since the start of the session
+CppExport SEXP _jetbrains_valueInfoCacheStats() {
+  CPP_BEGIN
+    const char* names[] = {"hits", "misses", "hitRatio", "size", ""};
+    ShieldSEXP result = Rf_mkNamed(REALSXP, names);
+    double hits = (double)valueInfoCache.getHits();
+    double misses = (double)valueInfoCache.getMisses();
+    REAL(result)[0] = hits;
+    REAL(result)[1] = misses;
+    REAL(result)[2] = hits + misses == 0 ? R_NaN : hits / (hits + misses);
+    REAL(result)[3] = (double)valueInfoCache.size();
+    return result;
+  CPP_END
+}
+
 CppExport SEXP _jetbrains_debugger_enable() {
   CPP_BEGIN
     rDebugger.enable();
@@ -355,6 +442,12 @@ static const R_CallMethodDef CallEntries[] = {
     {".jetbrains_ther_device_rescale_stored", (DL_FUNC) &_rplugingraphics_jetbrains_ther_device_rescale_stored, 6},
     {".jetbrains_ther_device_shutdown", (DL_FUNC) &_rplugingraphics_jetbrains_ther_device_shutdown, 0},
     {".jetbrains_View", (DL_FUNC) &_jetbrains_View, 3},
+    {".jetbrains_dataFrameColumnStats", (DL_FUNC) &_jetbrains_dataFrameColumnStats, 1},
+    {".jetbrains_environmentDiff", (DL_FUNC) &_jetbrains_environmentDiff, 3},
+    {".jetbrains_objectSize", (DL_FUNC) &_jetbrains_objectSize, 2},
+    {".jetbrains_mainThreadLatency", (DL_FUNC) &_jetbrains_mainThreadLatency, 0},
+    {".jetbrains_eventLoopStats", (DL_FUNC) &_jetbrains_eventLoopStats, 0},
+    {".jetbrains_valueInfoCacheStats", (DL_FUNC) &_jetbrains_valueInfoCacheStats, 0},
     {".jetbrains_debugger_enable", (DL_FUNC) &_jetbrains_debugger_enable, 0},
     {".jetbrains_debugger_disable", (DL_FUNC) &_jetbrains_debugger_disable, 0},
     {".jetbrains_exception_handler", (DL_FUNC) &_jetbrains_exception_handler, 1},
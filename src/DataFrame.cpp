@@ -19,19 +19,20 @@
 #include <grpcpp/server_builder.h>
 #include "IO.h"
 #include "RStuff/RUtil.h"
+#include "RStuff/VectorReader.h"
 #include "DataFrame.h"
-
-const char* ROW_NAMES_COL = "rwr_rownames_column";
-
-static bool initDplyr() {
-  try {
-    RI->loadNamespace("dplyr");
-    return true;
-  } catch (RError const& e) {
-    std::cerr << "Failed to load dplyr: " << e.what() << "\n";
-    return false;
-  }
-}
+#include "Options.h"
+#include "util/RadixSort.h"
+#include "EventLoop.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <numeric>
 
 bool isSupportedDataFrame(SEXP x) {
   return Rf_isMatrix(x) || isDataFrame(x);
@@ -42,18 +43,151 @@ static PrSEXP& getDataFrameStorageEnv() {
   return env;
 }
 
+// Identity of the frame contents: columns (or the matrix itself) and values of all attributes.
+// Any modification of a registered frame creates new vectors for the modified parts
 static std::vector<SEXP> getEqualityVector(SEXP _x) {
   ShieldSEXP x = _x;
-  std::vector<SEXP> v = {x};
-  v.push_back(Rf_getAttrib(x, Rf_install("names")));
-  v.push_back(Rf_getAttrib(x, Rf_install("rownames")));
+  std::vector<SEXP> v;
   if (x.type() == VECSXP) {
     for (int i = 0; i < x.length(); ++i) v.push_back(x[i]);
+  } else {
+    v.push_back(x);
+  }
+  for (SEXP attr = ATTRIB(x); attr != R_NilValue; attr = CDR(attr)) {
+    v.push_back(CAR(attr));
   }
   return v;
 }
 
-static std::unordered_map<int, DataFrameInfo*> dataFrameCache;
+struct EqualityVectorHash {
+  size_t operator () (std::vector<SEXP> const& v) const {
+    size_t hash = v.size();
+    for (SEXP x : v) hash = hash * 31 + std::hash<SEXP>()(x);
+    return hash;
+  }
+};
+
+static std::unordered_map<std::vector<SEXP>, DataFrameInfo*, EqualityVectorHash> dataFrameCache;
+
+// Registered frames and views, most recently used first
+static std::list<DataFrameInfo*> recentlyUsed;
+static std::unordered_map<DataFrameInfo*, std::list<DataFrameInfo*>::iterator> recentlyUsedPositions;
+static size_t totalMemoryUsage = 0;
+
+// The window following the last requested one (in the scrolling direction) is prepared when R is idle.
+// If the client asks for it, the response is sent without waiting for the main thread
+struct PrefetchedWindow {
+  int lastStart = 0;
+  int start = -1;
+  int end = -1;
+  std::unique_ptr<DataFrameGetDataResponse> response;
+};
+
+static std::mutex prefetchMutex;
+static std::unordered_map<int, PrefetchedWindow> prefetchedWindows;
+
+static void clearPrefetchedWindow(int refIndex) {
+  std::unique_lock<std::mutex> lock(prefetchMutex);
+  prefetchedWindows.erase(refIndex);
+}
+
+static void removeFromCache(DataFrameInfo *info) {
+  auto it = dataFrameCache.find(info->equalityVector);
+  if (it != dataFrameCache.end() && it->second == info) dataFrameCache.erase(it);
+}
+
+static void removeFromRecentlyUsed(DataFrameInfo *info) {
+  auto it = recentlyUsedPositions.find(info);
+  if (it == recentlyUsedPositions.end()) return;
+  recentlyUsed.erase(it->second);
+  recentlyUsedPositions.erase(it);
+  totalMemoryUsage -= info->memoryUsage;
+}
+
+static void markRecentlyUsed(DataFrameInfo *info) {
+  auto it = recentlyUsedPositions.find(info);
+  if (it == recentlyUsedPositions.end()) {
+    recentlyUsed.push_front(info);
+    recentlyUsedPositions[info] = recentlyUsed.begin();
+    totalMemoryUsage += info->memoryUsage;
+  } else {
+    recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, it->second);
+  }
+}
+
+static void setMemoryUsage(DataFrameInfo *info, size_t memoryUsage) {
+  if (recentlyUsedPositions.count(info)) totalMemoryUsage += memoryUsage - info->memoryUsage;
+  info->memoryUsage = memoryUsage;
+}
+
+// Releases the data but keeps the registration under its index:
+// the client still holds the reference, so the index must not be given to another object until it is disposed
+static void evictDataFrame(DataFrameInfo *info) {
+  removeFromRecentlyUsed(info);
+  removeFromCache(info);
+  clearPrefetchedWindow(info->refIndex);
+  getDataFrameStorageEnv().assign(std::to_string(info->uniqueIndex), R_NilValue);
+  info->isEvicted = true;
+  info->initialDataFrame = R_NilValue;
+  info->dataFrame = R_NilValue;
+  info->rowNames = R_NilValue;
+  info->nrow = 0;
+  info->rows = nullptr;
+  info->memoryUsage = 0;
+  info->equalityVector.clear();
+  info->changedColumns.clear();
+  info->columnProfilers.clear();
+  info->refresher = nullptr;
+  if (info->finalizer) {
+    info->finalizer();
+    info->finalizer = nullptr;
+  }
+}
+
+// Evicts least recently used registrations until the memory limit is satisfied, the most recent one is always kept
+static void evictDataFrames() {
+  size_t limit = (size_t)commandLineOptions.dataFrameMemoryLimitMB << 20;
+  if (limit == 0) return;
+  while (totalMemoryUsage > limit && recentlyUsed.size() > 1) {
+    evictDataFrame(recentlyUsed.back());
+  }
+}
+
+// Approximate size of the vectors kept alive by the registration.
+// Note: ALTREP columns that are not materialized (e.g. a compact 1:n) are not counted, they are read per window
+static size_t estimateMemoryUsage(DataFrameInfo *info) {
+  size_t size = info->rows ? info->rows->size() * sizeof(int) : 0;
+  if (info->rows) return size;
+  ShieldSEXP columns = info->dataFrame;
+  for (int i = 0; i < columns.length(); ++i) {
+    SEXP column = columns[i];
+    bool isAtomic = TYPEOF(column) == LGLSXP || TYPEOF(column) == INTSXP || TYPEOF(column) == REALSXP ||
+                    TYPEOF(column) == CPLXSXP || TYPEOF(column) == RAWSXP;
+    if (isAtomic && ALTREP(column) && DATAPTR_OR_NULL(column) == nullptr) continue;
+    switch (TYPEOF(column)) {
+      case LGLSXP:
+      case INTSXP:
+        size += Rf_xlength(column) * sizeof(int);
+        break;
+      case REALSXP:
+        size += Rf_xlength(column) * sizeof(double);
+        break;
+      case CPLXSXP:
+        size += Rf_xlength(column) * sizeof(Rcomplex);
+        break;
+      case STRSXP:
+      case VECSXP:
+        size += Rf_xlength(column) * sizeof(SEXP);
+        break;
+      case RAWSXP:
+        size += Rf_xlength(column);
+        break;
+      default:
+        break;
+    }
+  }
+  return size;
+}
 
 DataFrameInfo::DataFrameInfo() {
   static int currentIndex = 0;
@@ -63,92 +197,160 @@ DataFrameInfo::DataFrameInfo() {
 DataFrameInfo::~DataFrameInfo() {
   getDataFrameStorageEnv().assign(std::to_string(uniqueIndex), R_NilValue);
   if (finalizer) finalizer();
-  dataFrameCache.erase(uniqueIndex);
+  removeFromCache(this);
+  removeFromRecentlyUsed(this);
+  // Note: the index might have been given to another frame already, its window must be kept then
+  if (rpiService == nullptr || !rpiService->persistentRefStorage.has(refIndex)) clearPrefetchedWindow(refIndex);
 }
 
+// Row names are read from the attribute list directly since Rf_getAttrib expands compact row names
+static SEXP getRawRowNames(SEXP x) {
+  for (SEXP attr = ATTRIB(x); attr != R_NilValue; attr = CDR(attr)) {
+    if (TAG(attr) == R_RowNamesSymbol) return CAR(attr);
+  }
+  return R_NilValue;
+}
+
+static bool isCompactRowNames(SEXP rowNames) {
+  return TYPEOF(rowNames) == INTSXP && Rf_xlength(rowNames) == 2 && INTEGER(rowNames)[0] == NA_INTEGER;
+}
+
+static int getRowCount(SEXP rowNames) {
+  if (isCompactRowNames(rowNames)) return std::abs(INTEGER(rowNames)[1]);
+  return (int)Rf_xlength(rowNames);
+}
+
+static SEXP makeColumnList(SEXP dataFrame, std::vector<std::string> const& names) {
+  ShieldSEXP columns = Rf_allocVector(VECSXP, (int)names.size());
+  for (int i = 0; i < (int)names.size(); ++i) {
+    SET_VECTOR_ELT(columns, i, VECTOR_ELT(dataFrame, i));
+  }
+  ShieldSEXP namesVector = makeCharacterVector(names);
+  Rf_setAttrib(columns, R_NamesSymbol, namesVector);
+  return columns;
+}
+
+// Columns of the original frame are shared, not copied, and ALTREP columns are never materialized for viewing.
+// POSIXlt columns and row names are converted per requested window
 static void initDataFrame(DataFrameInfo *info) {
   PrSEXP dataFrame = info->initialDataFrame;
+  removeFromCache(info);
   info->equalityVector = getEqualityVector(dataFrame);
   getDataFrameStorageEnv().assign(std::to_string(info->uniqueIndex), dataFrame);
   if (Rf_isMatrix(dataFrame)) {
     dataFrame = RI->dataFrame(dataFrame, named("stringsAsFactors", false));
   }
-  if (!isDataFrame(dataFrame)) {
+  if (!isDataFrame(dataFrame) || TYPEOF(dataFrame) != VECSXP) {
     RI->stop("Object is not a valid data frame");
   }
 
-  int ncol = asInt(RI->ncol(dataFrame));
-  dataFrame = Rf_duplicate(dataFrame);
-  for (int i = 0; i < ncol; ++i) {
-    if (Rf_inherits(dataFrame[i], "POSIXlt")) {
-      SET_VECTOR_ELT(dataFrame, i, RI->asPOSIXct(dataFrame[i]));
-    }
-  }
-  ShieldSEXP namesList = RI->names(dataFrame);
+  int ncol = (int)dataFrame.length();
+  ShieldSEXP namesList = Rf_getAttrib(dataFrame, R_NamesSymbol);
   std::vector<std::string> names(ncol);
   for (int i = 0; i < ncol; ++i) {
     names[i] = i < namesList.length() && !namesList.isNA(i) ? stringEltUTF8(namesList, i) : "";
     if (names[i].empty()) names[i] = "Column " + std::to_string(i + 1);
   }
-  dataFrame = RI->namesAssign(dataFrame, names);
-  if (asBool(RI->dplyrIsTbl(dataFrame))) {
-    dataFrame = RI->dplyrUngroup(dataFrame);
-  } else {
-    if (!asBool(RI->isDataFrame(dataFrame))) {
-      dataFrame = RI->dataFrame(dataFrame, named("stringsAsFactors", false));
+  info->dataFrame = makeColumnList(dataFrame, names);
+  info->rowNames = getRawRowNames(dataFrame);
+  info->rowNamesType = DataFrameInfo::RowNamesType::UNKNOWN;
+  info->nrow = getRowCount(info->rowNames);
+  dataFrameCache[info->equalityVector] = info;
+  setMemoryUsage(info, estimateMemoryUsage(info));
+}
+
+static bool parseRowNameAsInt(const char* s, int &result) {
+  char* end;
+  errno = 0;
+  long value = strtol(s, &end, 10);
+  if (*s == 0 || *end != 0 || errno != 0 || value > INT_MAX || value <= INT_MIN) return false;
+  result = (int)value;
+  return true;
+}
+
+static bool parseRowNameAsDouble(const char* s, double &result) {
+  char* end;
+  double value = R_strtod(s, &end);
+  while (isspace(*end)) ++end;
+  if (end == s || *end != 0 || ISNA(value)) return false;
+  result = value;
+  return true;
+}
+
+// Same rules as strtoi() with fallback to as.numeric(), but without allocating converted vectors
+static DataFrameInfo::RowNamesType getRowNamesType(DataFrameInfo *info) {
+  using Type = DataFrameInfo::RowNamesType;
+  if (info->rowNamesType != Type::UNKNOWN) return info->rowNamesType;
+  SEXP rowNames = info->rowNames;
+  switch (TYPEOF(rowNames)) {
+    case INTSXP:
+    case NILSXP:
+      return info->rowNamesType = Type::INTEGER;
+    case REALSXP:
+      return info->rowNamesType = Type::DOUBLE;
+    case STRSXP: {
+      Type type = Type::INTEGER;
+      R_xlen_t length = Rf_xlength(rowNames);
+      for (R_xlen_t i = 0; i < length && type != Type::STRING; ++i) {
+        SEXP s = STRING_ELT(rowNames, i);
+        if (s == NA_STRING) {
+          type = Type::STRING;
+          break;
+        }
+        int intValue;
+        double doubleValue;
+        if (type == Type::INTEGER && parseRowNameAsInt(CHAR(s), intValue)) continue;
+        type = parseRowNameAsDouble(CHAR(s), doubleValue) ? Type::DOUBLE : Type::STRING;
+      }
+      return info->rowNamesType = type;
     }
-    // `rownames = NA` keep row names
-    dataFrame = RI->tibbleAsTibble(dataFrame, named("rownames", R_NaInt));
-  }
-  dataFrame = RI->tibbleRowNamesToColumn(dataFrame, ROW_NAMES_COL);
-  ShieldSEXP rowNamesColumn = RI->doubleSubscript(dataFrame, ROW_NAMES_COL);
-  PrSEXP rowNamesAsNum = RI->strtoi(rowNamesColumn); // As integer (but not numeric)
-  if (asBool(RI->any(RI->isNa(rowNamesAsNum)))) {
-    rowNamesAsNum = RI->asNumeric(rowNamesColumn); // As numeric
-  }
-  if (!asBool(RI->any(RI->isNa(rowNamesAsNum)))) {
-    dataFrame = RI->doubleSubscriptAssign(dataFrame, ROW_NAMES_COL, named("value", rowNamesAsNum));
+    default:
+      return info->rowNamesType = Type::STRING;
   }
-
-  info->dataFrame = dataFrame;
 }
 
-static DataFrameInfo *getDataFrameByRef(RRef const* ref) {
+// Returns null for evicted registrations, `isEvicted` tells them apart from invalid references
+static DataFrameInfo *getDataFrameByRef(RRef const* ref, bool* isEvicted = nullptr) {
   ShieldSEXP ptr = rpiService->dereference(*ref);
   if (ptr.type() != EXTPTRSXP) return nullptr;
-  return (DataFrameInfo*)R_ExternalPtrAddr(ptr);
+  DataFrameInfo *info = (DataFrameInfo*)R_ExternalPtrAddr(ptr);
+  if (info != nullptr && info->isEvicted) {
+    if (isEvicted != nullptr) *isEvicted = true;
+    return nullptr;
+  }
+  if (info != nullptr) markRecentlyUsed(info);
+  return info;
 }
 
 static DataFrameInfo *getDataFrameByRefIndex(int index) {
   if (!rpiService->persistentRefStorage.has(index)) return nullptr;
   ShieldSEXP ptr = rpiService->persistentRefStorage[index];
   if (ptr.type() != EXTPTRSXP) return nullptr;
-  return (DataFrameInfo*)R_ExternalPtrAddr(ptr);
+  DataFrameInfo *info = (DataFrameInfo*)R_ExternalPtrAddr(ptr);
+  return info != nullptr && !info->isEvicted ? info : nullptr;
 }
 
-DataFrameInfo *registerDataFrame(SEXP x, bool isTemporary) {
+static Status evictedStatus() {
+  return Status(grpc::StatusCode::FAILED_PRECONDITION, "Data frame was released to save memory, reopen it");
+}
+
+DataFrameInfo *registerDataFrame(SEXP x) {
   SHIELD(x);
-  if (!isTemporary) {
-    auto equalityVector = getEqualityVector(x);
-    for (auto const& p : dataFrameCache) {
-      DataFrameInfo *info = p.second;
-      if (info == getDataFrameByRefIndex(info->refIndex) && info->equalityVector == equalityVector) {
-        return info;
-      }
-    }
+  auto it = dataFrameCache.find(getEqualityVector(x));
+  if (it != dataFrameCache.end() && it->second == getDataFrameByRefIndex(it->second->refIndex)) {
+    markRecentlyUsed(it->second);
+    return it->second;
   }
   ShieldSEXP extPtr = rAlloc<DataFrameInfo>();
   DataFrameInfo *info = (DataFrameInfo*)R_ExternalPtrAddr(extPtr);
 
   info->initialDataFrame = x;
-  if (isTemporary) {
-    info->dataFrame = info->initialDataFrame;
-  } else {
-    dataFrameCache[info->uniqueIndex] = info;
-    initDataFrame(info);
-  }
+  initDataFrame(info);
 
   info->refIndex = rpiService->persistentRefStorage.add(extPtr);
+  clearPrefetchedWindow(info->refIndex);
+  markRecentlyUsed(info);
+  evictDataFrames();
   return info;
 }
 
@@ -207,7 +409,6 @@ static void createRefresher(DataFrameInfo *info, const RRef* _ref) {
 Status RPIServiceImpl::dataFrameRegister(ServerContext* context, const RRef* request, Int32Value* response) {
   response->set_value(-1);
   executeOnMainThread([&] {
-    if (!initDplyr()) return;
     PrSEXP dataFrame = dereference(*request);
     DataFrameInfo *info = registerDataFrame(dataFrame);
     createRefresher(info, request);
@@ -221,233 +422,949 @@ static std::string getClasses(SEXP obj) {
   return asStringUTF8(RI->paste(RI->classes(obj), named("collapse", ",")));
 }
 
+static void fillColumnType(DataFrameInfoResponse::Column *columnInfo, SEXP column) {
+  std::string cls = getClasses(column);
+  if (cls == "integer") {
+    columnInfo->set_type(DataFrameInfoResponse::INTEGER);
+    columnInfo->set_sortable(true);
+  } else if (cls == "numeric") {
+    columnInfo->set_type(DataFrameInfoResponse::DOUBLE);
+    columnInfo->set_sortable(true);
+  } else if (cls == "logical") {
+    columnInfo->set_type(DataFrameInfoResponse::BOOLEAN);
+    columnInfo->set_sortable(true);
+  } else {
+    columnInfo->set_type(DataFrameInfoResponse::STRING);
+    columnInfo->set_sortable(cls == "character" || Rf_inherits(column, "factor") ||
+                             Rf_inherits(column, "POSIXt"));
+  }
+}
+
+static const int PROFILING_CHUNK_ROWS = 1 << 20;
+
+// Column profiling runs in idle event loop tasks, each of them processes a limited number of rows
+static void scheduleProfiling(DataFrameInfo *info) {
+  if (info->isProfilingScheduled) return;
+  info->isProfilingScheduled = true;
+  int refIndex = info->refIndex;
+  int uniqueIndex = info->uniqueIndex;
+  eventLoopExecute([=] {
+    DataFrameInfo *info = getDataFrameByRefIndex(refIndex);
+    if (info == nullptr || info->uniqueIndex != uniqueIndex) return;
+    info->isProfilingScheduled = false;
+    int budget = PROFILING_CHUNK_ROWS;
+    bool isDone = true;
+    for (auto const& profiler : info->columnProfilers) {
+      while (budget > 0 && !profiler->isDone()) budget -= std::max(1, profiler->step(budget));
+      isDone = isDone && profiler->isDone();
+    }
+    if (!isDone) scheduleProfiling(info);
+  }, false, TaskPriority::BACKGROUND);
+}
+
+// Stats of columns that already have a profiler are kept
+static void startProfiling(DataFrameInfo *info) {
+  SEXP columns = info->dataFrame;
+  int ncol = (int)Rf_xlength(columns);
+  if ((int)info->columnProfilers.size() != ncol) info->columnProfilers.assign(ncol, nullptr);
+  for (int i = 0; i < ncol; ++i) {
+    if (info->columnProfilers[i]) continue;
+    info->columnProfilers[i] = std::make_shared<ColumnProfiler>(VECTOR_ELT(columns, i), info->rows, info->nrow);
+  }
+  scheduleProfiling(info);
+}
+
 Status RPIServiceImpl::dataFrameGetInfo(ServerContext* context, const RRef* request, DataFrameInfoResponse* response) {
+  bool isEvicted = false;
   executeOnMainThread([&] {
-    if (!initDplyr()) return;
-    DataFrameInfo *info = getDataFrameByRef(request);
+    DataFrameInfo *info = getDataFrameByRef(request, &isEvicted);
     if (info == nullptr) return;
     ShieldSEXP dataFrame = info->dataFrame;
     response->set_canrefresh(bool(info->refresher));
-    response->set_nrows(asInt(RI->nrow(dataFrame)));
-    ShieldSEXP names = RI->names(dataFrame);
-    int ncol = asInt(RI->ncol(dataFrame));
+    response->set_nrows(info->nrow);
+    DataFrameInfoResponse::Column *rowNamesInfo = response->add_columns();
+    rowNamesInfo->set_isrownames(true);
+    rowNamesInfo->set_sortable(true);
+    switch (getRowNamesType(info)) {
+      case DataFrameInfo::RowNamesType::INTEGER:
+        rowNamesInfo->set_type(DataFrameInfoResponse::INTEGER);
+        break;
+      case DataFrameInfo::RowNamesType::DOUBLE:
+        rowNamesInfo->set_type(DataFrameInfoResponse::DOUBLE);
+        break;
+      default:
+        rowNamesInfo->set_type(DataFrameInfoResponse::STRING);
+    }
+    ShieldSEXP names = Rf_getAttrib(dataFrame, R_NamesSymbol);
+    int ncol = (int)dataFrame.length();
     for (int i = 0; i < ncol; ++i) {
       DataFrameInfoResponse::Column *columnInfo = response->add_columns();
-      ShieldSEXP column = RI->doubleSubscript(dataFrame, i + 1);
-      std::string cls = getClasses(column);
-      const char* name = stringEltUTF8(names, i);
-      if (!strcmp(name, ROW_NAMES_COL)) {
-        columnInfo->set_isrownames(true);
-      } else {
-        columnInfo->set_name(name);
-      }
-      if (cls == "integer") {
-        columnInfo->set_type(DataFrameInfoResponse::INTEGER);
-        columnInfo->set_sortable(true);
-      } else if (cls == "numeric") {
-        columnInfo->set_type(DataFrameInfoResponse::DOUBLE);
-        columnInfo->set_sortable(true);
-      } else if (cls == "logical") {
-        columnInfo->set_type(DataFrameInfoResponse::BOOLEAN);
-        columnInfo->set_sortable(true);
-      } else {
-        columnInfo->set_type(DataFrameInfoResponse::STRING);
-        columnInfo->set_sortable(cls == "character" || Rf_inherits(column, "factor") ||
-                                 Rf_inherits(column, "POSIXt"));
-      }
+      columnInfo->set_name(stringEltUTF8(names, i));
+      fillColumnType(columnInfo, dataFrame[i]);
     }
+    startProfiling(info);
   }, context, true);
+  if (isEvicted) return evictedStatus();
   return Status::OK;
 }
 
-Status RPIServiceImpl::dataFrameGetData(ServerContext* context, const DataFrameGetDataRequest* request, DataFrameGetDataResponse* response) {
-  executeOnMainThread([&] {
-    if (!initDplyr()) return;
-    DataFrameInfo *info = getDataFrameByRef(&request->ref());
-    if (info == nullptr) return;
-    ShieldSEXP dataFrame = info->dataFrame;
-    int start = request->start();
-    int end = request->end();
-    int ncol = asInt(RI->ncol(dataFrame));
-    for (int i = 0; i < ncol; ++i) {
-      DataFrameGetDataResponse::Column* columnProto = response->add_columns();
-      ShieldSEXP wholeColumn = RI->doubleSubscript(dataFrame, i + 1);
-      ShieldSEXP column = RI->subscript(wholeColumn, RI->colon(start + 1, end));
-      std::string cls = getClasses(column);
-      if (cls == "integer") {
-        for (int j = 0; j < column.length(); ++j) {
-          if (column.isNA(j)) {
-            columnProto->add_values()->mutable_na();
-          } else {
-            columnProto->add_values()->set_intvalue(asInt(column[j]));
-          }
+static void fillRowNames(DataFrameGetDataResponse::Column* columnProto, DataFrameInfo *info, int start, int end) {
+  using Type = DataFrameInfo::RowNamesType;
+  SEXP rowNames = info->rowNames;
+  Type type = getRowNamesType(info);
+  const int* rows = info->rows ? info->rows->data() : nullptr;
+  auto values = columnProto->mutable_values();
+  values->Reserve(end - start);
+  for (int j = start; j < end; ++j) {
+    int row = rows ? rows[j] : j;
+    switch (TYPEOF(rowNames)) {
+      case INTSXP:
+        if (isCompactRowNames(rowNames)) {
+          values->Add()->set_intvalue(row + 1);
+        } else if (INTEGER_ELT(rowNames, row) == NA_INTEGER) {
+          values->Add()->mutable_na();
+        } else {
+          values->Add()->set_intvalue(INTEGER_ELT(rowNames, row));
         }
-      } else if (cls == "numeric") {
-        for (int j = 0; j < column.length(); ++j) {
-          if (column.isNA(j)) {
-            columnProto->add_values()->mutable_na();
-          } else {
-            columnProto->add_values()->set_doublevalue(asDouble(column[j]));
-          }
+        break;
+      case REALSXP:
+        if (R_IsNA(REAL_ELT(rowNames, row))) {
+          values->Add()->mutable_na();
+        } else {
+          values->Add()->set_doublevalue(REAL_ELT(rowNames, row));
+        }
+        break;
+      case STRSXP: {
+        SEXP s = STRING_ELT(rowNames, row);
+        int intValue;
+        double doubleValue;
+        if (s == NA_STRING) {
+          values->Add()->mutable_na();
+        } else if (type == Type::INTEGER && parseRowNameAsInt(CHAR(s), intValue)) {
+          values->Add()->set_intvalue(intValue);
+        } else if (type == Type::DOUBLE && parseRowNameAsDouble(CHAR(s), doubleValue)) {
+          values->Add()->set_doublevalue(doubleValue);
+        } else {
+          values->Add()->set_stringvalue(Rf_translateCharUTF8(s));
         }
-      } else if (cls == "logical") {
-        for (int j = 0; j < column.length(); ++j) {
-          if (column.isNA(j)) {
-            columnProto->add_values()->mutable_na();
+        break;
+      }
+      default:
+        values->Add()->set_intvalue(row + 1);
+    }
+  }
+}
+
+// Plain atomic vectors and factors are read natively, only the requested window of an ALTREP column is accessed.
+// Other classes are formatted by R
+static bool fillColumnNative(DataFrameGetDataResponse::Column* columnProto, SEXP column, const int* rows,
+                             int start, int end) {
+  if (Rf_getAttrib(column, R_DimSymbol) != R_NilValue) return false;
+  auto values = columnProto->mutable_values();
+  bool isFactor = TYPEOF(column) == INTSXP && Rf_inherits(column, "factor");
+  if (OBJECT(column) && !isFactor) return false;
+  switch (TYPEOF(column)) {
+    case INTSXP: {
+      values->Reserve(end - start);
+      IntVectorReader reader(column);
+      const int* window = rows ? nullptr : reader.region(start, end - start);
+      auto value = [&](int j) { return window ? window[j - start] : reader[rows[j]]; };
+      if (isFactor) {
+        SEXP levels = Rf_getAttrib(column, R_LevelsSymbol);
+        int levelsCount = TYPEOF(levels) == STRSXP ? (int)Rf_xlength(levels) : 0;
+        for (int j = start; j < end; ++j) {
+          int code = value(j);
+          if (code == NA_INTEGER) {
+            values->Add()->mutable_na();
+          } else if (code < 1 || code > levelsCount || STRING_ELT(levels, code - 1) == NA_STRING) {
+            values->Add()->set_stringvalue("NA");
           } else {
-            columnProto->add_values()->set_booleanvalue(asBool(column[j]));
+            values->Add()->set_stringvalue(Rf_translateCharUTF8(STRING_ELT(levels, code - 1)));
           }
         }
       } else {
-        for (int j = 0; j < column.length(); ++j) {
-          if (column.isNA(j)) {
-            columnProto->add_values()->mutable_na();
+        for (int j = start; j < end; ++j) {
+          int x = value(j);
+          if (x == NA_INTEGER) {
+            values->Add()->mutable_na();
           } else {
-            columnProto->add_values()->set_stringvalue(
-              asStringUTF8(RI->paste(RI->doubleSubscript(column, j + 1), named("collapse", "; "))));
+            values->Add()->set_intvalue(x);
           }
         }
       }
+      return true;
+    }
+    case REALSXP: {
+      values->Reserve(end - start);
+      DoubleVectorReader reader(column);
+      const double* window = rows ? nullptr : reader.region(start, end - start);
+      for (int j = start; j < end; ++j) {
+        double x = window ? window[j - start] : reader[rows[j]];
+        if (R_IsNA(x)) {
+          values->Add()->mutable_na();
+        } else {
+          values->Add()->set_doublevalue(x);
+        }
+      }
+      return true;
+    }
+    case LGLSXP: {
+      values->Reserve(end - start);
+      IntVectorReader reader(column);
+      const int* window = rows ? nullptr : reader.region(start, end - start);
+      for (int j = start; j < end; ++j) {
+        int x = window ? window[j - start] : reader[rows[j]];
+        if (x == NA_LOGICAL) {
+          values->Add()->mutable_na();
+        } else {
+          values->Add()->set_booleanvalue(x != 0);
+        }
+      }
+      return true;
+    }
+    case STRSXP: {
+      values->Reserve(end - start);
+      for (int j = start; j < end; ++j) {
+        int row = rows ? rows[j] : j;
+        SEXP s = STRING_ELT(column, row);
+        if (s == NA_STRING) {
+          values->Add()->mutable_na();
+        } else {
+          values->Add()->set_stringvalue(Rf_translateCharUTF8(s));
+        }
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+static SEXP makeRowIndex(const int* rows, int start, int end) {
+  // Note: `start + 1`:`end` would count down for an empty window
+  if (rows == nullptr && start >= end) return Rf_allocVector(INTSXP, 0);
+  if (rows == nullptr) return RI->colon(start + 1, end);
+  ShieldSEXP index = Rf_allocVector(INTSXP, end - start);
+  for (int j = start; j < end; ++j) INTEGER(index)[j - start] = rows[j] + 1;
+  return index;
+}
+
+static void fillColumnWithR(DataFrameGetDataResponse::Column* columnProto, SEXP wholeColumn, const int* rows,
+                            int start, int end) {
+  PrSEXP column = RI->subscript(wholeColumn, makeRowIndex(rows, start, end));
+  if (Rf_inherits(column, "POSIXlt")) {
+    column = RI->asPOSIXct(column);
+  }
+  std::string cls = getClasses(column);
+  if (cls == "integer") {
+    for (int j = 0; j < column.length(); ++j) {
+      if (column.isNA(j)) {
+        columnProto->add_values()->mutable_na();
+      } else {
+        columnProto->add_values()->set_intvalue(asInt(column[j]));
+      }
+    }
+  } else if (cls == "numeric") {
+    for (int j = 0; j < column.length(); ++j) {
+      if (column.isNA(j)) {
+        columnProto->add_values()->mutable_na();
+      } else {
+        columnProto->add_values()->set_doublevalue(asDouble(column[j]));
+      }
+    }
+  } else if (cls == "logical") {
+    for (int j = 0; j < column.length(); ++j) {
+      if (column.isNA(j)) {
+        columnProto->add_values()->mutable_na();
+      } else {
+        columnProto->add_values()->set_booleanvalue(asBool(column[j]));
+      }
+    }
+  } else {
+    for (int j = 0; j < column.length(); ++j) {
+      if (column.isNA(j)) {
+        columnProto->add_values()->mutable_na();
+      } else {
+        columnProto->add_values()->set_stringvalue(
+          asStringUTF8(RI->paste(RI->doubleSubscript(column, j + 1), named("collapse", "; "))));
+      }
+    }
+  }
+}
+
+static void fillDataWindow(DataFrameGetDataResponse* response, DataFrameInfo *info, int start, int end) {
+  ShieldSEXP dataFrame = info->dataFrame;
+  int ncol = (int)dataFrame.length();
+  start = std::max(0, start);
+  end = std::min(info->nrow, end);
+  if (start > end) start = end;
+  response->mutable_columns()->Reserve(ncol + 1);
+  fillRowNames(response->add_columns(), info, start, end);
+  const int* rows = info->rows ? info->rows->data() : nullptr;
+  int baseRowCount = getRowCount(info->rowNames);
+  for (int i = 0; i < ncol; ++i) {
+    DataFrameGetDataResponse::Column* columnProto = response->add_columns();
+    ShieldSEXP column = dataFrame[i];
+    if (Rf_xlength(column) < baseRowCount || !fillColumnNative(columnProto, column, rows, start, end)) {
+      columnProto->clear_values();
+      fillColumnWithR(columnProto, column, rows, start, end);
+    }
+  }
+}
+
+static bool takePrefetchedWindow(int refIndex, int start, int end, DataFrameGetDataResponse* response) {
+  std::unique_lock<std::mutex> lock(prefetchMutex);
+  auto it = prefetchedWindows.find(refIndex);
+  if (it == prefetchedWindows.end() || it->second.start != start || it->second.end != end) return false;
+  response->Swap(it->second.response.get());
+  it->second.response = nullptr;
+  it->second.start = it->second.end = -1;
+  return true;
+}
+
+static void prefetchNextWindow(int refIndex, int start, int end) {
+  int size = end - start;
+  if (size <= 0) return;
+  int nextStart;
+  {
+    std::unique_lock<std::mutex> lock(prefetchMutex);
+    PrefetchedWindow &window = prefetchedWindows[refIndex];
+    nextStart = start >= window.lastStart ? end : start - size;
+    window.lastStart = start;
+    window.response = nullptr;
+    window.start = window.end = -1;
+  }
+  if (nextStart < 0) return;
+  // Scrolling further makes the pending prefetch useless, so a new one replaces it
+  TaskOptions options(TaskPriority::BACKGROUND);
+  options.supersedeKey = "dataFramePrefetch:" + std::to_string(refIndex);
+  eventLoopExecute([=] {
+    DataFrameInfo *info = getDataFrameByRefIndex(refIndex);
+    if (info == nullptr || nextStart >= info->nrow) return;
+    markRecentlyUsed(info);
+    std::unique_ptr<DataFrameGetDataResponse> response(new DataFrameGetDataResponse());
+    try {
+      fillDataWindow(response.get(), info, nextStart, nextStart + size);
+    } catch (RExceptionBase const&) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(prefetchMutex);
+    auto it = prefetchedWindows.find(refIndex);
+    if (it == prefetchedWindows.end() || it->second.lastStart != start) return;
+    it->second.start = nextStart;
+    it->second.end = nextStart + size;
+    it->second.response = std::move(response);
+  }, false, options);
+}
+
+Status RPIServiceImpl::dataFrameGetData(ServerContext* context, const DataFrameGetDataRequest* request, DataFrameGetDataResponse* response) {
+  int start = request->start();
+  int end = request->end();
+  if (request->ref().ref_case() == RRef::kPersistentIndex) {
+    int refIndex = request->ref().persistentindex();
+    if (takePrefetchedWindow(refIndex, start, end, response)) {
+      prefetchNextWindow(refIndex, start, end);
+      return Status::OK;
+    }
+  }
+  bool isEvicted = false;
+  executeOnMainThread([&] {
+    DataFrameInfo *info = getDataFrameByRef(&request->ref(), &isEvicted);
+    if (info == nullptr) return;
+    fillDataWindow(response, info, start, end);
+    if (request->ref().ref_case() == RRef::kPersistentIndex) {
+      prefetchNextWindow(request->ref().persistentindex(), start, end);
     }
   }, context, true);
+  if (isEvicted) return evictedStatus();
   return Status::OK;
 }
 
+static SEXP materializeRowNames(DataFrameInfo *info) {
+  using Type = DataFrameInfo::RowNamesType;
+  SEXP rowNames = info->rowNames;
+  int baseRowCount = getRowCount(rowNames);
+  if (TYPEOF(rowNames) != STRSXP) {
+    if (TYPEOF(rowNames) == REALSXP || (TYPEOF(rowNames) == INTSXP && !isCompactRowNames(rowNames))) {
+      return rowNames;
+    }
+    ShieldSEXP result = Rf_allocVector(INTSXP, baseRowCount);
+    for (int i = 0; i < baseRowCount; ++i) INTEGER(result)[i] = i + 1;
+    return result;
+  }
+  Type type = getRowNamesType(info);
+  if (type == Type::STRING) return rowNames;
+  ShieldSEXP result = Rf_allocVector(type == Type::INTEGER ? INTSXP : REALSXP, baseRowCount);
+  for (int i = 0; i < baseRowCount; ++i) {
+    const char* s = CHAR(STRING_ELT(rowNames, i));
+    if (type == Type::INTEGER) {
+      parseRowNameAsInt(s, INTEGER(result)[i]);
+    } else {
+      parseRowNameAsDouble(s, REAL(result)[i]);
+    }
+  }
+  return result;
+}
+
+// Views share columns with the parent frame and show its rows in the given order
+static DataFrameInfo *registerDataFrameView(DataFrameInfo *parent, std::vector<int> rows) {
+  ShieldSEXP extPtr = rAlloc<DataFrameInfo>();
+  DataFrameInfo *info = (DataFrameInfo*)R_ExternalPtrAddr(extPtr);
+  info->initialDataFrame = parent->initialDataFrame;
+  info->dataFrame = parent->dataFrame;
+  info->rowNames = parent->rowNames;
+  info->rowNamesType = parent->rowNamesType;
+  info->nrow = (int)rows.size();
+  info->rows = std::make_shared<const std::vector<int>>(std::move(rows));
+  info->memoryUsage = estimateMemoryUsage(info);
+  info->refIndex = rpiService->persistentRefStorage.add(extPtr);
+  clearPrefetchedWindow(info->refIndex);
+  markRecentlyUsed(info);
+  evictDataFrames();
+  return info;
+}
+
+static std::vector<int> getCollationRanks(SEXP column, std::vector<int> const& rows, int baseRowCount) {
+  std::unordered_map<SEXP, int> ranksByString;
+  std::vector<SEXP> strings;
+  for (int row : rows) {
+    SEXP s = STRING_ELT(column, row);
+    if (s != NA_STRING && ranksByString.emplace(s, 0).second) strings.push_back(s);
+  }
+  // Note: unique strings are ordered by R so that the result agrees with order() (ICU collation etc.)
+  int count = (int)strings.size();
+  ShieldSEXP uniqueStrings = Rf_allocVector(STRSXP, count);
+  for (int i = 0; i < count; ++i) SET_STRING_ELT(uniqueStrings, i, strings[i]);
+  std::vector<int> order(count);
+  R_orderVector1(order.data(), count, uniqueStrings, TRUE, FALSE);
+  for (int i = 0; i < count; ++i) ranksByString[strings[order[i]]] = i;
+  std::vector<int> ranks(baseRowCount, NA_INTEGER);
+  for (int row : rows) {
+    SEXP s = STRING_ELT(column, row);
+    if (s != NA_STRING) ranks[row] = ranksByString[s];
+  }
+  return ranks;
+}
+
+static void sortRowsByInts(std::vector<int> &rows, std::vector<int> &buffer, const int* data, bool descending) {
+  radixSort<uint32_t>(rows, buffer, [=](int row) { return intSortKey(data[row], descending); });
+}
+
+static void sortRowsByDoubles(std::vector<int> &rows, std::vector<int> &buffer, const double* data, bool descending) {
+  radixSort<uint64_t>(rows, buffer, [=](int row) { return doubleSortKey(data[row], descending); });
+}
+
+// Note: sorting needs the whole column, an ALTREP one is copied by region for the duration of the sort
+// instead of being materialized and kept alive inside the object
+static void sortRowsByVector(std::vector<int> &rows, std::vector<int> &buffer, SEXP data, bool descending) {
+  R_xlen_t length = Rf_xlength(data);
+  switch (TYPEOF(data)) {
+    case INTSXP:
+    case LGLSXP: {
+      IntVectorReader reader(data);
+      sortRowsByInts(rows, buffer, reader.region(0, length), descending);
+      break;
+    }
+    case REALSXP: {
+      DoubleVectorReader reader(data);
+      sortRowsByDoubles(rows, buffer, reader.region(0, length), descending);
+      break;
+    }
+    case STRSXP: {
+      std::vector<int> ranks = getCollationRanks(data, rows, (int)Rf_xlength(data));
+      sortRowsByInts(rows, buffer, ranks.data(), descending);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// Stable sort of `rows` by one column (row names have index 0), NA values go last in both directions
+static void sortRowsByColumn(std::vector<int> &rows, std::vector<int> &buffer, DataFrameInfo *info,
+                             int columnIndex, bool descending) {
+  int baseRowCount = getRowCount(info->rowNames);
+  if (columnIndex == 0) {
+    SEXP rowNames = info->rowNames;
+    if (TYPEOF(rowNames) == NILSXP || isCompactRowNames(rowNames)) {
+      radixSort<uint32_t>(rows, buffer, [=](int row) { return intSortKey(row, descending); });
+    } else {
+      ShieldSEXP values = materializeRowNames(info);
+      sortRowsByVector(rows, buffer, values, descending);
+    }
+    return;
+  }
+  ShieldSEXP columns = info->dataFrame;
+  if (columnIndex < 0 || columnIndex > columns.length()) return;
+  ShieldSEXP column = columns[columnIndex - 1];
+  bool isPlain = !OBJECT(column) || (TYPEOF(column) == INTSXP && Rf_inherits(column, "factor"));
+  // Other classes are ranked by xtfrm(), that's what order() does as well
+  ShieldSEXP data = isPlain && Rf_getAttrib(column, R_DimSymbol) == R_NilValue ? (SEXP)column : RI->xtfrm(column);
+  if (Rf_xlength(data) != baseRowCount) return;
+  sortRowsByVector(rows, buffer, data, descending);
+}
+
 Status RPIServiceImpl::dataFrameSort(ServerContext* context, const DataFrameSortRequest* request, Int32Value* response) {
   response->set_value(-1);
   executeOnMainThread([&] {
-    if (!initDplyr()) return;
     DataFrameInfo *info = getDataFrameByRef(&request->ref());
     if (info == nullptr) return;
-    ShieldSEXP dataFrame = info->dataFrame;
-    std::vector<PrSEXP> arrangeArgs = {dataFrame};
-    for (auto const& key : request->keys()) {
-      if (key.descending()) {
-        arrangeArgs.emplace_back(RI->dplyrDesc(RI->doubleSubscript(dataFrame, key.columnindex() + 1)));
-      } else {
-        arrangeArgs.emplace_back(RI->doubleSubscript(dataFrame, key.columnindex() + 1));
-      }
+    std::vector<int> rows;
+    if (info->rows) {
+      rows = *info->rows;
+    } else {
+      rows.resize(info->nrow);
+      std::iota(rows.begin(), rows.end(), 0);
     }
-    DataFrameInfo *newInfo = registerDataFrame(invokeFunction(RI->dplyrArrange, arrangeArgs), true);
+    std::vector<int> buffer;
+    auto const& keys = request->keys();
+    for (int i = keys.size() - 1; i >= 0; --i) {
+      sortRowsByColumn(rows, buffer, info, keys[i].columnindex(), keys[i].descending());
+    }
+    DataFrameInfo *newInfo = registerDataFrameView(info, std::move(rows));
     response->set_value(newInfo->refIndex);
   }, context, true);
   return Status::OK;
 }
 
-static SEXP applyFilter(SEXP df, DataFrameFilterRequest::Filter const& filter) {
-  SHIELD(df);
-  int nrow = asInt(RI->nrow(df));
-  if (filter.has_true_()) {
-    return RI->rep(true, nrow);
+// Result of a filter in three-valued logic, one bit per row of the view: `value` is meaningful where `known` is set
+struct FilterMask {
+  int size;
+  std::vector<uint64_t> value;
+  std::vector<uint64_t> known;
+
+  explicit FilterMask(int size, bool initialValue = true) : size(size),
+    value(wordCount(size), initialValue ? ~(uint64_t)0 : 0), known(wordCount(size), ~(uint64_t)0) {}
+
+  static size_t wordCount(int size) { return ((size_t)size + 63) / 64; }
+
+  void andWith(FilterMask const& other) {
+    for (size_t i = 0; i < value.size(); ++i) {
+      uint64_t falseA = known[i] & ~value[i], falseB = other.known[i] & ~other.value[i];
+      known[i] = (known[i] & other.known[i]) | falseA | falseB;
+      value[i] &= other.value[i];
+    }
   }
-  if (filter.has_composed()) {
-    switch (filter.composed().type()) {
-      case DataFrameFilterRequest_Filter_ComposedFilter_Type_AND: {
-        PrSEXP result = RI->rep(true, nrow);
-        for (auto const& f : filter.composed().filters()) {
-          result = RI->vectorAnd(result, applyFilter(df, f));
-        }
-        return result;
+
+  void orWith(FilterMask const& other) {
+    for (size_t i = 0; i < value.size(); ++i) {
+      uint64_t trueA = known[i] & value[i], trueB = other.known[i] & other.value[i];
+      known[i] = (known[i] & other.known[i]) | trueA | trueB;
+      value[i] = trueA | trueB | (value[i] & other.value[i]);
+    }
+  }
+
+  void negate() {
+    for (uint64_t &word : value) word = ~word;
+  }
+};
+
+// Fills the mask in blocks of 64 rows with branch-free loops, so that the compiler can vectorize the plain case
+template <typename IsKnown, typename Test>
+static void scanRows(FilterMask &mask, const int* rows, IsKnown const& isKnown, Test const& test) {
+  int n = mask.size;
+  for (size_t w = 0; w < mask.value.size(); ++w) {
+    int begin = (int)w * 64;
+    int count = std::min(64, n - begin);
+    uint64_t value = 0, known = 0;
+    if (rows == nullptr) {
+      for (int b = 0; b < count; ++b) {
+        value |= (uint64_t)test(begin + b) << b;
+        known |= (uint64_t)isKnown(begin + b) << b;
       }
-      case DataFrameFilterRequest_Filter_ComposedFilter_Type_OR: {
-        PrSEXP result = RI->rep(false, nrow);
-        for (auto const& f : filter.composed().filters()) {
-          result = RI->vectorOr(result, applyFilter(df, f));
+    } else {
+      for (int b = 0; b < count; ++b) {
+        int row = rows[begin + b];
+        value |= (uint64_t)test(row) << b;
+        known |= (uint64_t)isKnown(row) << b;
+      }
+    }
+    mask.value[w] = value;
+    mask.known[w] = known;
+  }
+}
+
+// Same as scanRows, but the predicates take values of a logical, integer or double column.
+// The column is read block by block, so an ALTREP one is never materialized
+template <typename T, typename IsKnown, typename Test>
+static void scanValues(FilterMask &mask, const int* rows, SEXP column, IsKnown const& isKnown, Test const& test) {
+  VectorReader<T> reader(column);
+  T gathered[64];
+  int n = mask.size;
+  for (size_t w = 0; w < mask.value.size(); ++w) {
+    int begin = (int)w * 64;
+    int count = std::min(64, n - begin);
+    const T* values = gathered;
+    if (rows == nullptr) {
+      values = reader.region(begin, count);
+    } else {
+      for (int b = 0; b < count; ++b) gathered[b] = reader[rows[begin + b]];
+    }
+    uint64_t value = 0, known = 0;
+    for (int b = 0; b < count; ++b) {
+      value |= (uint64_t)test(values[b]) << b;
+      known |= (uint64_t)isKnown(values[b]) << b;
+    }
+    mask.value[w] = value;
+    mask.known[w] = known;
+  }
+}
+
+template <typename T>
+static bool compareValues(DataFrameFilterRequest_Filter_Operator_Type type, T a, T b) {
+  switch (type) {
+    case DataFrameFilterRequest_Filter_Operator_Type_EQ: return a == b;
+    case DataFrameFilterRequest_Filter_Operator_Type_NEQ: return a != b;
+    case DataFrameFilterRequest_Filter_Operator_Type_LESS: return a < b;
+    case DataFrameFilterRequest_Filter_Operator_Type_GREATER: return a > b;
+    case DataFrameFilterRequest_Filter_Operator_Type_LEQ: return a <= b;
+    case DataFrameFilterRequest_Filter_Operator_Type_GEQ: return a >= b;
+    default: return true;
+  }
+}
+
+template <typename T>
+static void scanCompare(FilterMask &mask, const int* rows, SEXP column, T na, T constant,
+                        DataFrameFilterRequest_Filter_Operator_Type type) {
+  switch (type) {
+#define RWR_SCAN_COMPARE(TYPE, OP) \
+    case DataFrameFilterRequest_Filter_Operator_Type_##TYPE: \
+      scanValues<T>(mask, rows, column, [=](T x) { return x != na; }, [=](T x) { return x OP constant; }); \
+      break;
+    RWR_SCAN_COMPARE(EQ, ==)
+    RWR_SCAN_COMPARE(NEQ, !=)
+    RWR_SCAN_COMPARE(LESS, <)
+    RWR_SCAN_COMPARE(GREATER, >)
+    RWR_SCAN_COMPARE(LEQ, <=)
+    RWR_SCAN_COMPARE(GEQ, >=)
+#undef RWR_SCAN_COMPARE
+    default:
+      break;
+  }
+}
+
+static void scanCompareDoubles(FilterMask &mask, const int* rows, SEXP column, double constant,
+                               DataFrameFilterRequest_Filter_Operator_Type type) {
+  auto isKnown = [](double x) { return !ISNAN(x); };
+  switch (type) {
+#define RWR_SCAN_COMPARE(TYPE, OP) \
+    case DataFrameFilterRequest_Filter_Operator_Type_##TYPE: \
+      scanValues<double>(mask, rows, column, isKnown, [=](double x) { return x OP constant; }); \
+      break;
+    RWR_SCAN_COMPARE(EQ, ==)
+    RWR_SCAN_COMPARE(NEQ, !=)
+    RWR_SCAN_COMPARE(LESS, <)
+    RWR_SCAN_COMPARE(GREATER, >)
+    RWR_SCAN_COMPARE(LEQ, <=)
+    RWR_SCAN_COMPARE(GEQ, >=)
+#undef RWR_SCAN_COMPARE
+    default:
+      break;
+  }
+}
+
+// Logical vector computed by R over all rows of the columns
+static bool scanLogical(FilterMask &mask, const int* rows, SEXP result, int baseRowCount) {
+  if (TYPEOF(result) != LGLSXP || Rf_xlength(result) != baseRowCount) return false;
+  scanValues<int>(mask, rows, result, [](int x) { return x != NA_LOGICAL; }, [](int x) { return x != 0; });
+  return true;
+}
+
+static bool isStringEqual(SEXP s, SEXP constant, const char* constantUTF8) {
+  if (s == constant) return true;
+  const void *vmax = vmaxget();
+  bool result = !strcmp(Rf_translateCharUTF8(s), constantUTF8);
+  vmaxset(vmax);
+  return result;
+}
+
+static void applyOperatorFilter(FilterMask &mask, DataFrameInfo *info, DataFrameFilterRequest::Filter::Operator const& filter) {
+  const int* rows = info->rows ? info->rows->data() : nullptr;
+  int baseRowCount = getRowCount(info->rowNames);
+  ShieldSEXP columns = info->dataFrame;
+  if (filter.column() < 0 || filter.column() > columns.length()) return;
+  PrSEXP column = filter.column() == 0 ? materializeRowNames(info) : (SEXP)columns[filter.column() - 1];
+  if (Rf_inherits(column, "POSIXlt")) column = RI->asPOSIXct(column);
+  std::string const& strValue = filter.value();
+  DataFrameFilterRequest_Filter_Operator_Type type = filter.type();
+  bool isFactor = TYPEOF(column) == INTSXP && Rf_inherits(column, "factor");
+  bool isPlain = (!OBJECT(column) || isFactor) && Rf_getAttrib(column, R_DimSymbol) == R_NilValue &&
+                 Rf_xlength(column) == baseRowCount;
+
+  if (type == DataFrameFilterRequest_Filter_Operator_Type_REGEX) {
+    try {
+      if (isPlain && isFactor) {
+        ShieldSEXP levelMatches = RI->grepl(strValue, Rf_getAttrib(column, R_LevelsSymbol));
+        const int* matches = LOGICAL(levelMatches);
+        int levelsCount = (int)Rf_xlength(levelMatches);
+        scanValues<int>(mask, rows, column, [](int) { return true; }, [=](int code) {
+          return code != NA_INTEGER && code >= 1 && code <= levelsCount && matches[code - 1];
+        });
+      } else {
+        scanLogical(mask, rows, RI->grepl(strValue, column), baseRowCount);
+      }
+    } catch (RError const&) {
+    }
+    return;
+  }
+
+  if (isPlain && isFactor && (type == DataFrameFilterRequest_Filter_Operator_Type_EQ ||
+                              type == DataFrameFilterRequest_Filter_Operator_Type_NEQ)) {
+    SEXP levels = Rf_getAttrib(column, R_LevelsSymbol);
+    int levelsCount = TYPEOF(levels) == STRSXP ? (int)Rf_xlength(levels) : 0;
+    ShieldSEXP constant = mkCharUTF8(strValue);
+    int code = NA_INTEGER;
+    for (int i = 0; i < levelsCount && code == NA_INTEGER; ++i) {
+      if (STRING_ELT(levels, i) != NA_STRING && isStringEqual(STRING_ELT(levels, i), constant, strValue.c_str())) {
+        code = i + 1;
+      }
+    }
+    // If there is no such level, code stays NA_INTEGER and no known value is equal to it
+    scanCompare<int>(mask, rows, column, NA_INTEGER, code, type);
+    return;
+  }
+
+  if (isPlain && !isFactor) {
+    switch (TYPEOF(column)) {
+      case INTSXP:
+      case LGLSXP: {
+        bool isLogical = TYPEOF(column) == LGLSXP;
+        int constant;
+        if (isLogical) {
+          ShieldSEXP constantSEXP = RI->asLogical(strValue);
+          constant = LOGICAL(constantSEXP)[0];
+        } else {
+          ShieldSEXP constantSEXP = RI->asInteger(strValue);
+          constant = INTEGER(constantSEXP)[0];
+        }
+        if (constant == NA_INTEGER) {
+          std::fill(mask.known.begin(), mask.known.end(), 0);
+        } else {
+          scanCompare<int>(mask, rows, column, NA_INTEGER, constant, type);
         }
-        return result;
+        return;
       }
-      case DataFrameFilterRequest_Filter_ComposedFilter_Type_NOT: {
-        PrSEXP result = RI->rep(true, nrow);
-        for (auto const& f : filter.composed().filters()) {
-          result = RI->vectorAnd(result, applyFilter(df, f));
+      case REALSXP: {
+        ShieldSEXP constantSEXP = RI->asDouble(strValue);
+        double constant = REAL(constantSEXP)[0];
+        if (ISNAN(constant)) {
+          std::fill(mask.known.begin(), mask.known.end(), 0);
+        } else {
+          scanCompareDoubles(mask, rows, column, constant, type);
         }
-        return RI->vectorNot(result);
+        return;
       }
-      default:
-        return RI->rep(true, nrow);
-    }
-  }
-  if (filter.has_operator_()) {
-    ShieldSEXP column = RI->doubleSubscript(df, filter.operator_().column() + 1);
-    std::string cls = getClasses(column);
-    std::string const& strValue = filter.operator_().value();
-    PrSEXP value;
-    if (cls == "integer") {
-      value = RI->asInteger(strValue);
-    } else if (cls == "numeric") {
-      value = RI->asDouble(strValue);
-    } else if (cls == "logical") {
-      value = RI->asLogical(strValue);
-    } else {
-      value = toSEXP(strValue);
-    }
-    switch (filter.operator_().type()) {
-      case DataFrameFilterRequest_Filter_Operator_Type_EQ:
-        return RI->eq(column, value);
-      case DataFrameFilterRequest_Filter_Operator_Type_NEQ:
-        return RI->neq(column, value);
-      case DataFrameFilterRequest_Filter_Operator_Type_LESS:
-        return RI->less(column, value);
-      case DataFrameFilterRequest_Filter_Operator_Type_GREATER:
-        return RI->greater(column, value);
-      case DataFrameFilterRequest_Filter_Operator_Type_LEQ:
-        return RI->leq(column, value);
-      case DataFrameFilterRequest_Filter_Operator_Type_GEQ:
-        return RI->geq(column, value);
-      case DataFrameFilterRequest_Filter_Operator_Type_REGEX:
-        try {
-          return RI->grepl(strValue, column);
-        } catch (RError const&) {
+      case STRSXP:
+        if (type == DataFrameFilterRequest_Filter_Operator_Type_EQ ||
+            type == DataFrameFilterRequest_Filter_Operator_Type_NEQ) {
+          ShieldSEXP constant = mkCharUTF8(strValue);
+          const char* constantUTF8 = strValue.c_str();
+          bool equal = type == DataFrameFilterRequest_Filter_Operator_Type_EQ;
+          SEXP columnSEXP = column;
+          scanRows(mask, rows, [=](int row) { return STRING_ELT(columnSEXP, row) != NA_STRING; }, [&](int row) {
+            SEXP s = STRING_ELT(columnSEXP, row);
+            return s != NA_STRING && isStringEqual(s, constant, constantUTF8) == equal;
+          });
+          return;
         }
+        break;
       default:
-        return RI->rep(true, nrow);
+        break;
     }
   }
-  if (filter.has_nafilter()) {
-    ShieldSEXP column = RI->doubleSubscript(df, filter.nafilter().column() + 1);
-    if (filter.nafilter().isna()) {
-      return RI->isNa(column);
-    } else {
-      return RI->vectorNot(RI->isNa(column));
+
+  // Collation order for strings and classes like Date are left to R operators
+  PrSEXP value = toSEXP(strValue);
+  if (!OBJECT(column)) {
+    if (TYPEOF(column) == INTSXP) value = RI->asInteger(strValue);
+    if (TYPEOF(column) == REALSXP) value = RI->asDouble(strValue);
+    if (TYPEOF(column) == LGLSXP) value = RI->asLogical(strValue);
+  }
+  switch (type) {
+    case DataFrameFilterRequest_Filter_Operator_Type_EQ:
+      scanLogical(mask, rows, RI->eq(column, value), baseRowCount);
+      break;
+    case DataFrameFilterRequest_Filter_Operator_Type_NEQ:
+      scanLogical(mask, rows, RI->neq(column, value), baseRowCount);
+      break;
+    case DataFrameFilterRequest_Filter_Operator_Type_LESS:
+      scanLogical(mask, rows, RI->less(column, value), baseRowCount);
+      break;
+    case DataFrameFilterRequest_Filter_Operator_Type_GREATER:
+      scanLogical(mask, rows, RI->greater(column, value), baseRowCount);
+      break;
+    case DataFrameFilterRequest_Filter_Operator_Type_LEQ:
+      scanLogical(mask, rows, RI->leq(column, value), baseRowCount);
+      break;
+    case DataFrameFilterRequest_Filter_Operator_Type_GEQ:
+      scanLogical(mask, rows, RI->geq(column, value), baseRowCount);
+      break;
+    default:
+      break;
+  }
+}
+
+static void applyNaFilter(FilterMask &mask, DataFrameInfo *info, DataFrameFilterRequest::Filter::NaFilter const& filter) {
+  const int* rows = info->rows ? info->rows->data() : nullptr;
+  int baseRowCount = getRowCount(info->rowNames);
+  ShieldSEXP columns = info->dataFrame;
+  if (filter.column() < 0 || filter.column() > columns.length()) return;
+  PrSEXP column = filter.column() == 0 ? materializeRowNames(info) : (SEXP)columns[filter.column() - 1];
+  bool isNa = filter.isna();
+  bool isPlain = (!OBJECT(column) || Rf_inherits(column, "factor")) && Rf_xlength(column) == baseRowCount;
+  auto always = [](int) { return true; };
+  switch (isPlain ? TYPEOF(column) : NILSXP) {
+    case INTSXP:
+    case LGLSXP: {
+      scanValues<int>(mask, rows, column, always, [=](int x) { return (x == NA_INTEGER) == isNa; });
+      break;
+    }
+    case REALSXP: {
+      scanValues<double>(mask, rows, column, always, [=](double x) { return (bool)ISNAN(x) == isNa; });
+      break;
+    }
+    case STRSXP: {
+      SEXP columnSEXP = column;
+      scanRows(mask, rows, always, [=](int row) { return (STRING_ELT(columnSEXP, row) == NA_STRING) == isNa; });
+      break;
     }
+    default:
+      if (scanLogical(mask, rows, RI->isNa(column), baseRowCount) && !isNa) mask.negate();
+  }
+}
+
+static void applyFilter(FilterMask &mask, DataFrameInfo *info, DataFrameFilterRequest::Filter const& filter) {
+  if (filter.has_composed()) {
+    auto type = filter.composed().type();
+    if (type != DataFrameFilterRequest_Filter_ComposedFilter_Type_AND &&
+        type != DataFrameFilterRequest_Filter_ComposedFilter_Type_OR &&
+        type != DataFrameFilterRequest_Filter_ComposedFilter_Type_NOT) {
+      return;
+    }
+    bool isOr = type == DataFrameFilterRequest_Filter_ComposedFilter_Type_OR;
+    FilterMask result(mask.size, !isOr);
+    for (auto const& f : filter.composed().filters()) {
+      FilterMask current(mask.size);
+      applyFilter(current, info, f);
+      if (isOr) {
+        result.orWith(current);
+      } else {
+        result.andWith(current);
+      }
+    }
+    if (type == DataFrameFilterRequest_Filter_ComposedFilter_Type_NOT) result.negate();
+    mask = std::move(result);
+  } else if (filter.has_operator_()) {
+    applyOperatorFilter(mask, info, filter.operator_());
+  } else if (filter.has_nafilter()) {
+    applyNaFilter(mask, info, filter.nafilter());
   }
-  return RI->rep(true, nrow);
 }
 
 Status RPIServiceImpl::dataFrameFilter(ServerContext* context, const DataFrameFilterRequest* request, Int32Value* response) {
   response->set_value(-1);
   executeOnMainThread([&] {
-    if (!initDplyr()) return;
     DataFrameInfo *info = getDataFrameByRef(&request->ref());
     if (info == nullptr) return;
-    ShieldSEXP dataFrame = info->dataFrame;
-    ShieldSEXP maskWithNa = applyFilter(dataFrame, request->filter());
-    ShieldSEXP mask = RI->replace(maskWithNa, RI->isNa(maskWithNa), false);
-    PrSEXP call = R_NilValue;
-    for (int i = (int)dataFrame.length() - 1; i >= 0; --i) {
-      call = Rf_lcons(RI->subscript(dataFrame[i], mask), call);
-      SET_TAG(call, Rf_install(std::to_string(i).c_str()));
+    FilterMask mask(info->nrow);
+    applyFilter(mask, info, request->filter());
+    const int* rows = info->rows ? info->rows->data() : nullptr;
+    std::vector<int> selection;
+    for (size_t w = 0; w < mask.value.size(); ++w) {
+      uint64_t word = mask.value[w] & mask.known[w];
+      for (int b = 0; word != 0; ++b, word >>= 1) {
+        int position = (int)w * 64 + b;
+        if ((word & 1) && position < info->nrow) selection.push_back(rows ? rows[position] : position);
+      }
     }
-    ShieldSEXP names = RI->names(dataFrame);
-    ShieldSEXP newDataFrame = RI->namesAssign(safeEval(Rf_lcons(RI->dplyrTibble, call), R_GlobalEnv), names);
-
-    DataFrameInfo *newInfo = registerDataFrame(newDataFrame, true);
+    DataFrameInfo *newInfo = registerDataFrameView(info, std::move(selection));
     response->set_value(newInfo->refIndex);
   }, context, true);
   return Status::OK;
 }
 
+// Client-side indices of the columns that differ, row names have index 0.
+// If the set of columns has changed, all of them are reported
+static std::vector<int> getChangedColumns(SEXP oldColumns, SEXP oldRowNames, DataFrameInfo *info) {
+  ShieldSEXP columns = info->dataFrame;
+  int ncol = (int)columns.length();
+  SEXP oldNames = Rf_getAttrib(oldColumns, R_NamesSymbol);
+  SEXP names = Rf_getAttrib(columns, R_NamesSymbol);
+  bool sameStructure = Rf_xlength(oldColumns) == ncol;
+  for (int i = 0; i < ncol && sameStructure; ++i) {
+    sameStructure = !strcmp(stringEltUTF8(oldNames, i), stringEltUTF8(names, i));
+  }
+  std::vector<int> changed;
+  if (!sameStructure || oldRowNames != info->rowNames) changed.push_back(0);
+  for (int i = 0; i < ncol; ++i) {
+    if (!sameStructure || VECTOR_ELT(oldColumns, i) != VECTOR_ELT(columns, i)) changed.push_back(i + 1);
+  }
+  return changed;
+}
+
 Status RPIServiceImpl::dataFrameRefresh(ServerContext* context, const RRef* request, BoolValue* response) {
   executeOnMainThread([&] {
-    if (!initDplyr()) return;
     DataFrameInfo *info = getDataFrameByRef(request);
     if (info == nullptr) return;
     if (!info->refresher) return;
     ShieldSEXP newTable = info->refresher();
     if (!isSupportedDataFrame(newTable) || getEqualityVector(newTable) == info->equalityVector) return;
+    ShieldSEXP oldColumns = info->dataFrame;
+    ShieldSEXP oldRowNames = info->rowNames;
+    auto oldRowNamesType = info->rowNamesType;
     info->initialDataFrame = newTable;
     initDataFrame(info);
+    clearPrefetchedWindow(info->refIndex);
+    // Only the changed columns are processed again, everything derived from the other ones is kept
+    info->changedColumns = getChangedColumns(oldColumns, oldRowNames, info);
+    if (oldRowNames == info->rowNames) info->rowNamesType = oldRowNamesType;
+    if (!info->columnProfilers.empty()) {
+      if (info->columnProfilers.size() != (size_t)Rf_xlength(info->dataFrame)) info->columnProfilers.clear();
+      for (int column : info->changedColumns) {
+        if (column > 0 && column <= (int)info->columnProfilers.size()) info->columnProfilers[column - 1] = nullptr;
+      }
+      startProfiling(info);
+    }
     response->set_value(true);
   }, context, true);
   return Status::OK;
 }
+
+static SEXP makeColumnStats(ColumnStats const& stats) {
+  const char* names[] = {"naCount", "count", "distinctCount", "min", "max", "mean", "histogram", "histogramRange", ""};
+  ShieldSEXP result = Rf_mkNamed(VECSXP, names);
+  SET_VECTOR_ELT(result, 0, Rf_ScalarReal((double)stats.naCount));
+  SET_VECTOR_ELT(result, 1, Rf_ScalarReal((double)stats.count));
+  SET_VECTOR_ELT(result, 2, Rf_ScalarReal(stats.distinctCount));
+  if (!stats.isNumeric) return result;
+  SET_VECTOR_ELT(result, 3, Rf_ScalarReal(stats.min));
+  SET_VECTOR_ELT(result, 4, Rf_ScalarReal(stats.max));
+  SET_VECTOR_ELT(result, 5, Rf_ScalarReal(stats.mean));
+  if (stats.histogram.empty()) return result;
+  SEXP histogram = Rf_allocVector(REALSXP, (int)stats.histogram.size());
+  SET_VECTOR_ELT(result, 6, histogram);
+  for (size_t i = 0; i < stats.histogram.size(); ++i) REAL(histogram)[i] = (double)stats.histogram[i];
+  SEXP range = Rf_allocVector(REALSXP, 2);
+  SET_VECTOR_ELT(result, 7, range);
+  REAL(range)[0] = stats.histogramMin;
+  REAL(range)[1] = stats.histogramMax;
+  return result;
+}
+
+// Named list of column stats for a registered data frame, NULL for columns that are not profiled yet
+SEXP getDataFrameColumnStats(SEXP x) {
+  auto it = dataFrameCache.find(getEqualityVector(x));
+  if (it == dataFrameCache.end()) return R_NilValue;
+  DataFrameInfo *info = it->second;
+  if (info->columnProfilers.empty()) {
+    startProfiling(info);
+    return R_NilValue;
+  }
+  int ncol = (int)info->columnProfilers.size();
+  ShieldSEXP result = Rf_allocVector(VECSXP, ncol);
+  for (int i = 0; i < ncol; ++i) {
+    if (info->columnProfilers[i]->isDone()) SET_VECTOR_ELT(result, i, makeColumnStats(info->columnProfilers[i]->getStats()));
+  }
+  Rf_setAttrib(result, R_NamesSymbol, Rf_getAttrib(info->dataFrame, R_NamesSymbol));
+  return result;
+}
@@ -19,14 +19,28 @@
 
 #include "RStuff/RInclude.h"
 #include "RStuff/MySEXP.h"
+#include "DataFrameStats.h"
 #include <functional>
+#include <memory>
+#include <vector>
 
 struct DataFrameInfo {
-  int refIndex;
+  enum class RowNamesType { UNKNOWN, INTEGER, DOUBLE, STRING };
+
+  int refIndex = -1;
   int uniqueIndex;
   PrSEXP initialDataFrame;
   std::vector<SEXP> equalityVector;
-  PrSEXP dataFrame;
+  PrSEXP dataFrame; // Named list of columns, shared with initialDataFrame
+  PrSEXP rowNames; // Row names as stored in the attribute (may be compact)
+  RowNamesType rowNamesType = RowNamesType::UNKNOWN;
+  int nrow = 0;
+  std::shared_ptr<const std::vector<int>> rows; // Rows of the columns shown by this view, all of them if null
+  size_t memoryUsage = 0;
+  std::vector<int> changedColumns; // Columns changed by the last refresh, row names have index 0
+  std::vector<std::shared_ptr<ColumnProfiler>> columnProfilers; // Empty until the frame is shown
+  bool isProfilingScheduled = false;
+  bool isEvicted = false; // Data was released to satisfy the memory limit, the reference is kept until the client disposes it
   std::function<SEXP()> refresher;
   std::function<void()> finalizer;
 
@@ -35,6 +49,7 @@ struct DataFrameInfo {
 };
 
 bool isSupportedDataFrame(SEXP x);
-DataFrameInfo *registerDataFrame(SEXP x, bool isTemporary = false);
+DataFrameInfo *registerDataFrame(SEXP x);
+SEXP getDataFrameColumnStats(SEXP x);
 
 #endif //RWRAPPER_EVENT_LOOP_H
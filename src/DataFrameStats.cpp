@@ -0,0 +1,161 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "DataFrameStats.h"
+#include "RStuff/VectorReader.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+ColumnProfiler::ColumnProfiler(SEXP column, std::shared_ptr<const std::vector<int>> rows, int nrow)
+  : column(column), rows(std::move(rows)), nrow(nrow) {
+  if (Rf_isFactor(column)) {
+    kind = CODES;
+  } else if (TYPEOF(column) == STRSXP) {
+    kind = STRING;
+  } else if (OBJECT(column) && !Rf_inherits(column, "Date") && !Rf_inherits(column, "POSIXct") &&
+             !Rf_inherits(column, "difftime")) {
+    kind = UNSUPPORTED;
+  } else if (TYPEOF(column) == INTSXP || TYPEOF(column) == LGLSXP) {
+    kind = INTEGER;
+  } else if (TYPEOF(column) == REALSXP) {
+    kind = DOUBLE;
+  } else {
+    kind = UNSUPPORTED;
+  }
+  stats.isNumeric = kind == INTEGER || kind == DOUBLE;
+  if (kind == UNSUPPORTED) pass = DONE;
+}
+
+// Calls `f` for the values at positions [start, end) of the view.
+// Note: only these rows of an ALTREP column are read, INTEGER() and REAL() would materialize all of it
+template <typename T, typename Func>
+static void forEachValue(SEXP column, const int* rowIndex, int start, int end, Func const& f) {
+  VectorReader<T> reader(column);
+  if (rowIndex == nullptr) {
+    const T* data = reader.region(start, end - start);
+    for (int i = 0; i < end - start; ++i) f(data[i]);
+  } else {
+    for (int i = start; i < end; ++i) f(reader[rowIndex[i]]);
+  }
+}
+
+int ColumnProfiler::step(int maxRows) {
+  if (pass == DONE) return 0;
+  int start = position;
+  int end = (int)std::min((long long)nrow, (long long)start + maxRows);
+  const int* rowIndex = rows ? rows->data() : nullptr;
+  auto row = [&](int i) { return rowIndex ? rowIndex[i] : i; };
+
+  if (pass == VALUES) {
+    switch (kind) {
+      case INTEGER:
+      case CODES: {
+        forEachValue<int>(column, rowIndex, start, end, [&](int x) {
+          if (x == NA_INTEGER) {
+            ++stats.naCount;
+            return;
+          }
+          distinct.add(mixHash((uint32_t)x));
+          if (kind == CODES) return;
+          sum += x;
+          finiteMin = std::min(finiteMin, (double)x);
+          finiteMax = std::max(finiteMax, (double)x);
+        });
+        break;
+      }
+      case DOUBLE: {
+        forEachValue<double>(column, rowIndex, start, end, [&](double x) {
+          if (ISNAN(x)) {
+            ++stats.naCount;
+            return;
+          }
+          if (x == 0) x = 0; // -0.0 and 0.0 are equal
+          uint64_t bits;
+          memcpy(&bits, &x, sizeof(bits));
+          distinct.add(mixHash(bits));
+          sum += x;
+          if (R_FINITE(x)) {
+            finiteMin = std::min(finiteMin, x);
+            finiteMax = std::max(finiteMax, x);
+          } else {
+            stats.min = std::min(ISNAN(stats.min) ? x : stats.min, x);
+            stats.max = std::max(ISNAN(stats.max) ? x : stats.max, x);
+          }
+        });
+        break;
+      }
+      case STRING: {
+        // Strings are cached by R, so equal strings in the same encoding share CHARSXP
+        for (int i = start; i < end; ++i) {
+          SEXP s = STRING_ELT(column, row(i));
+          if (s == NA_STRING) {
+            ++stats.naCount;
+            continue;
+          }
+          distinct.add(mixHash((uint64_t)(uintptr_t)s));
+        }
+        break;
+      }
+      default:
+        break;
+    }
+    position = end;
+    if (position >= nrow) finishValues();
+    return end - start;
+  }
+
+  double range = finiteMax - finiteMin;
+  auto addToHistogram = [&](double x) {
+    int bin = range > 0 ? (int)((x - finiteMin) / range * ColumnStats::HISTOGRAM_BINS) : 0;
+    ++stats.histogram[std::min(bin, ColumnStats::HISTOGRAM_BINS - 1)];
+  };
+  if (kind == INTEGER) {
+    forEachValue<int>(column, rowIndex, start, end, [&](int x) {
+      if (x != NA_INTEGER) addToHistogram(x);
+    });
+  } else {
+    forEachValue<double>(column, rowIndex, start, end, [&](double x) {
+      if (R_FINITE(x)) addToHistogram(x);
+    });
+  }
+  position = end;
+  if (position >= nrow) pass = DONE;
+  return end - start;
+}
+
+void ColumnProfiler::finishValues() {
+  stats.count = nrow - stats.naCount;
+  stats.distinctCount = std::min((double)stats.count, std::round(distinct.estimate()));
+  if (!stats.isNumeric || stats.count == 0) {
+    pass = DONE;
+    return;
+  }
+  stats.mean = (double)(sum / stats.count);
+  if (finiteMin <= finiteMax) {
+    stats.min = ISNAN(stats.min) ? finiteMin : std::min(stats.min, finiteMin);
+    stats.max = ISNAN(stats.max) ? finiteMax : std::max(stats.max, finiteMax);
+    stats.histogramMin = finiteMin;
+    stats.histogramMax = finiteMax;
+    stats.histogram.assign(ColumnStats::HISTOGRAM_BINS, 0);
+    pass = HISTOGRAM;
+    position = 0;
+  } else {
+    pass = DONE;
+  }
+}
@@ -0,0 +1,71 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RWRAPPER_DATA_FRAME_STATS_H
+#define RWRAPPER_DATA_FRAME_STATS_H
+
+#include "RStuff/RInclude.h"
+#include "RStuff/MySEXP.h"
+#include "util/HyperLogLog.h"
+#include <memory>
+#include <vector>
+
+struct ColumnStats {
+  static const int HISTOGRAM_BINS = 20;
+
+  bool isNumeric = false; // min, max, mean and histogram are set only for numeric columns
+  long long naCount = 0;
+  long long count = 0; // Number of non-NA values
+  double distinctCount = 0;
+  double min = R_NaN;
+  double max = R_NaN;
+  double mean = R_NaN;
+  double histogramMin = 0; // Bins split [histogramMin, histogramMax] evenly, infinite values are not counted
+  double histogramMax = 0;
+  std::vector<long long> histogram;
+};
+
+// Profiles a column in steps of limited size so that it can be interleaved with other work.
+// Numeric columns are scanned twice: the histogram range is known only after the first pass
+class ColumnProfiler {
+public:
+  ColumnProfiler(SEXP column, std::shared_ptr<const std::vector<int>> rows, int nrow);
+
+  // Processes at most `maxRows` rows, returns the number of processed rows
+  int step(int maxRows);
+  bool isDone() const { return pass == DONE; }
+  ColumnStats const& getStats() const { return stats; }
+
+private:
+  enum Kind { INTEGER, DOUBLE, CODES, STRING, UNSUPPORTED };
+  enum Pass { VALUES, HISTOGRAM, DONE };
+
+  void finishValues();
+
+  PrSEXP column;
+  std::shared_ptr<const std::vector<int>> rows;
+  int nrow;
+  Kind kind;
+  Pass pass = VALUES;
+  int position = 0;
+  long double sum = 0;
+  double finiteMin = R_PosInf;
+  double finiteMax = R_NegInf;
+  HyperLogLog distinct;
+  ColumnStats stats;
+};
+
+#endif //RWRAPPER_DATA_FRAME_STATS_H
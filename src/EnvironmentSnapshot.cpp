@@ -0,0 +1,108 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "EnvironmentSnapshot.h"
+#include "RStuff/RUtil.h"
+#include "ValueInfoCache.h"
+#include "util/HyperLogLog.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+static const size_t MAX_SNAPSHOTS = 16;
+static const R_xlen_t MAX_IDENTITY_ELEMENTS = 10000;
+
+struct EnvironmentSnapshot {
+  PrSEXP env;
+  bool allNames;
+  std::unordered_map<SEXP, uint64_t> bindings; // Symbol -> identity of the value
+};
+
+// Ordered by token, so the oldest snapshots are evicted first
+static std::map<int, EnvironmentSnapshot> snapshots;
+static int lastToken = 0;
+
+static uint64_t bindingIdentity(SEXP env, SEXP symbol) {
+  // Active bindings are not called, they have no value of their own
+  if (R_BindingIsActive(symbol, env)) return mixHash((uint64_t)symbol) ^ 1;
+  SEXP value = Rf_findVarInFrame(env, symbol);
+  if (TYPEOF(value) == PROMSXP) {
+    if (PRVALUE(value) == R_UnboundValue) return mixHash((uint64_t)value) ^ 2;
+    value = PRVALUE(value);
+  }
+  // Rebinding changes the address. The fingerprint and the elements of lists catch most of the changes made in place
+  uint64_t identity = mixHash((uint64_t)value);
+  uint64_t hash;
+  if (valueInfoCache.fingerprint(value, hash)) identity = mixHash(identity ^ hash);
+  if (TYPEOF(value) == VECSXP || TYPEOF(value) == EXPRSXP) {
+    R_xlen_t length = std::min(XLENGTH(value), MAX_IDENTITY_ELEMENTS);
+    for (R_xlen_t i = 0; i < length; ++i) identity = mixHash(identity ^ (uint64_t)VECTOR_ELT(value, i));
+  }
+  return identity;
+}
+
+static SEXP symbolNames(std::vector<SEXP> const& symbols) {
+  ShieldSEXP result = Rf_allocVector(STRSXP, symbols.size());
+  for (size_t i = 0; i < symbols.size(); ++i) SET_STRING_ELT(result, i, PRINTNAME(symbols[i]));
+  return result;
+}
+
+SEXP environmentDiff(SEXP env, int token, bool allNames) {
+  if (TYPEOF(env) != ENVSXP) throw std::invalid_argument("Environment expected");
+  EnvironmentSnapshot snapshot;
+  snapshot.env = env;
+  snapshot.allNames = allNames;
+  forEachBindingSymbol(env, allNames, [&](SEXP symbol) {
+    snapshot.bindings[symbol] = bindingIdentity(env, symbol);
+  });
+
+  std::vector<SEXP> added, removed, modified;
+  auto it = snapshots.find(token);
+  bool isFull = it == snapshots.end() || it->second.env != env || it->second.allNames != allNames;
+  if (isFull) {
+    for (auto const& binding : snapshot.bindings) added.push_back(binding.first);
+  } else {
+    auto const& old = it->second.bindings;
+    for (auto const& binding : snapshot.bindings) {
+      auto oldBinding = old.find(binding.first);
+      if (oldBinding == old.end()) {
+        added.push_back(binding.first);
+      } else if (oldBinding->second != binding.second) {
+        modified.push_back(binding.first);
+      }
+    }
+    for (auto const& binding : old) {
+      if (!snapshot.bindings.count(binding.first)) removed.push_back(binding.first);
+    }
+    snapshots.erase(it);
+  }
+
+  int newToken = ++lastToken;
+  snapshots.emplace(newToken, std::move(snapshot));
+  while (snapshots.size() > MAX_SNAPSHOTS) snapshots.erase(snapshots.begin());
+
+  const char* names[] = {"token", "added", "removed", "modified", "isFull", ""};
+  ShieldSEXP result = Rf_mkNamed(VECSXP, names);
+  SET_VECTOR_ELT(result, 0, Rf_ScalarInteger(newToken));
+  SET_VECTOR_ELT(result, 1, symbolNames(added));
+  SET_VECTOR_ELT(result, 2, symbolNames(removed));
+  SET_VECTOR_ELT(result, 3, symbolNames(modified));
+  SET_VECTOR_ELT(result, 4, Rf_ScalarLogical(isFull));
+  return result;
+}
@@ -0,0 +1,30 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_ENVIRONMENT_SNAPSHOT_H
+#define RWRAPPER_ENVIRONMENT_SNAPSHOT_H
+
+#include "RStuff/RInclude.h"
+
+// Returns list(token, added, removed, modified, isFull) describing changes of the bindings of `env`
+// since the snapshot identified by `token`, and takes a new snapshot.
+// If `token` is unknown (e.g. 0), all bindings are reported as added and isFull is TRUE.
+// A binding is modified if its value was rebound or changed in a way that is visible in the variables view.
+// Must be called on the main thread
+SEXP environmentDiff(SEXP env, int token, bool allNames);
+
+#endif //RWRAPPER_ENVIRONMENT_SNAPSHOT_H
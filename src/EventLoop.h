@@ -17,16 +17,20 @@
 #ifndef RWRAPPER_EVENT_LOOP_H
 #define RWRAPPER_EVENT_LOOP_H
 
+#include "util/TaskScheduler.h"
 #include <functional>
 #include <string>
 
 void initEventLoop();
 void quitEventLoop();
-void eventLoopExecute(std::function<void()> const& f, bool immediate = false);
+uint64_t eventLoopExecute(std::function<void()> const& f, bool immediate = false, TaskOptions const& options = TaskOptions());
+// Removes a task that hasn't started yet, returns false if it is already running or done
+bool eventLoopCancel(uint64_t id, bool immediate);
 void breakEventLoop(std::string s = "");
 std::string runEventLoop(bool disableOutput = true);
 bool isEventHandlerRunning();
 void runImmediateTasks();
+TaskScheduler const& getEventLoopScheduler(bool immediate);
 
 void initLaterAPI();
 
@@ -20,7 +20,7 @@
 #include "RStuff/RInclude.h"
 #include "RStuff/RUtil.h"
 #include "debugger/RDebugger.h"
-#include "util/BlockingQueue.h"
+#include "util/TaskScheduler.h"
 #include <unistd.h>
 
 static const int ACTIVITY = 27;
@@ -28,8 +28,8 @@ static int eventLoopPipe[2];
 static std::mutex pipeMutex;
 static bool pipeFilled = false;
 
-static BlockingQueue<std::function<void()>> queue;
-static BlockingQueue<std::function<void()>> immediateQueue;
+static TaskScheduler queue;
+static TaskScheduler immediateQueue;
 static bool doBreakEventLoop = false;
 static std::string breakEventLoopValue;
 static volatile bool _isEventHandlerRunning = false;
@@ -61,18 +61,24 @@ void quitEventLoop() {
   close(eventLoopPipe[1]);
 }
 
-void eventLoopExecute(std::function<void()> const& f, bool immediate) {
+uint64_t eventLoopExecute(std::function<void()> const& f, bool immediate, TaskOptions const& options) {
   std::unique_lock<std::mutex> lock(pipeMutex);
+  uint64_t id;
   if (immediate) {
-    immediateQueue.push(f);
+    id = immediateQueue.push(f, options);
     executeWithLater(runImmediateTasks);
   } else {
-    queue.push(f);
+    id = queue.push(f, options);
   }
-  if (pipeFilled) return;
+  if (pipeFilled) return id;
   char c = '\0';
   write(eventLoopPipe[1], &c, 1);
   pipeFilled = true;
+  return id;
+}
+
+bool eventLoopCancel(uint64_t id, bool immediate) {
+  return (immediate ? immediateQueue : queue).cancel(id);
 }
 
 void breakEventLoop(std::string s) {
@@ -105,6 +111,10 @@ std::string runEventLoop(bool disableOutput) {
   }
 }
 
+TaskScheduler const& getEventLoopScheduler(bool immediate) {
+  return immediate ? immediateQueue : queue;
+}
+
 bool isEventHandlerRunning() {
   return _isEventHandlerRunning;
 }
@@ -15,7 +15,7 @@
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "EventLoop.h"
-#include "util/BlockingQueue.h"
+#include "util/TaskScheduler.h"
 #include "IO.h"
 #include "debugger/RDebugger.h"
 #include <windows.h>
@@ -23,8 +23,8 @@
 #include "RStuff/Export.h"
 
 static HWND dummyWindow;
-static BlockingQueue<std::function<void()>> queue;
-static BlockingQueue<std::function<void()>> immediateQueue;
+static TaskScheduler queue;
+static TaskScheduler immediateQueue;
 static bool doBreakEventLoop = false;
 static std::string breakEventLoopValue;
 static volatile bool _isEventHandlerRunning = false;
@@ -59,14 +59,20 @@ void quitEventLoop() {
   DestroyWindow(dummyWindow);
 }
 
-void eventLoopExecute(std::function<void()> const& f, bool immediate) {
+uint64_t eventLoopExecute(std::function<void()> const& f, bool immediate, TaskOptions const& options) {
+  uint64_t id;
   if (immediate) {
-    immediateQueue.push(f);
+    id = immediateQueue.push(f, options);
     executeWithLater(runImmediateTasks);
   } else {
-    queue.push(f);
+    id = queue.push(f, options);
   }
   PostMessage(dummyWindow, WM_USER, 0, 0);
+  return id;
+}
+
+bool eventLoopCancel(uint64_t id, bool immediate) {
+  return (immediate ? immediateQueue : queue).cancel(id);
 }
 
 void breakEventLoop(std::string s) {
@@ -99,6 +105,10 @@ std::string runEventLoop(bool disableOutput) {
   }
 }
 
+TaskScheduler const& getEventLoopScheduler(bool immediate) {
+  return immediate ? immediateQueue : queue;
+}
+
 bool isEventHandlerRunning() {
   return _isEventHandlerRunning;
 }
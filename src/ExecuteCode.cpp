@@ -18,6 +18,7 @@
 #include "IO.h"
 #include "RPIServiceImpl.h"
 #include "RStuff/RUtil.h"
+#include "ValueInfoCache.h"
 #include "debugger/SourceFileManager.h"
 #include "util/ScopedAssign.h"
 #include <grpcpp/server_builder.h>
@@ -83,6 +84,9 @@ Status RPIServiceImpl::executeCode(ServerContext* context, const ExecuteCodeRequ
 
     auto finally = Finally {[&] {
       if (isRepl) {
+        // Note: internal commands don't advance the generation, otherwise e.g. a burst of plot rescales
+        // would evict the whole cache
+        valueInfoCache.nextGeneration();
         AsyncEvent event;
         if (replState == DEBUG_PROMPT) {
           event.mutable_debugprompt()->set_changed(false);
@@ -90,7 +94,7 @@ Status RPIServiceImpl::executeCode(ServerContext* context, const ExecuteCodeRequ
           event.mutable_prompt();
           rDebugger.clearSavedStack();
         }
-        asyncEvents.push(event);
+        sendAsyncEvent(event);
       }
     }};
 
@@ -101,7 +105,7 @@ Status RPIServiceImpl::executeCode(ServerContext* context, const ExecuteCodeRequ
       if (isRepl) {
         AsyncEvent event;
         event.mutable_busy();
-        asyncEvents.push(event);
+        sendAsyncEvent(event);
         rDebugger.resetLastErrorStack();
         if (isDebug) {
           if (firstDebugCommand == ExecuteCodeRequest_DebugCommand_CONTINUE) {
@@ -150,7 +154,7 @@ Status RPIServiceImpl::executeCode(ServerContext* context, const ExecuteCodeRequ
     } catch (RJumpToToplevelException const&) {
     }
     if (disableBytecode) RDebugger::setBytecodeEnabled(true);
-  }, context);
+  }, context, false, request->isrepl() ? TaskPriority::INTERACTIVE : TaskPriority::UI);
   return Status::OK;
 }
 
@@ -158,11 +162,11 @@ std::string RPIServiceImpl::readLineHandler(std::string const& prompt) {
   if (replState != REPL_BUSY) return "";
   AsyncEvent event;
   event.mutable_requestreadln()->set_prompt(prompt);
-  asyncEvents.push(event);
+  sendAsyncEvent(event);
   ScopedAssign<ReplState> withState(replState, READ_LINE);
   std::string result = runEventLoop();
   event.mutable_busy();
-  asyncEvents.push(event);
+  sendAsyncEvent(event);
   return result;
 }
 
@@ -170,15 +174,17 @@ void RPIServiceImpl::debugPromptHandler() {
   if (replState != REPL_BUSY) return;
   AsyncEvent event;
   rDebugger.buildDebugPrompt(event.mutable_debugprompt());
-  asyncEvents.push(event);
+  sendAsyncEvent(event);
   ScopedAssign<ReplState> withState(replState, DEBUG_PROMPT);
   runEventLoop();
   event.mutable_busy();
-  asyncEvents.push(event);
+  sendAsyncEvent(event);
 }
 
-Status RPIServiceImpl::executeCommand(ServerContext* context, const std::string& command, ServerWriter<CommandOutput>* writer) {
+Status RPIServiceImpl::executeCommand(ServerContext* context, const std::string& command, ServerWriter<CommandOutput>* writer,
+                                      std::function<bool()> const& isObsolete) {
   executeOnMainThread([&] {
+    if (isObsolete && isObsolete()) return;
     std::cerr << "Executing " << command << "\n";
     WithOutputHandler withOutputHandler([&](const char* buf, int len, OutputType type) {
       CommandOutput response;
@@ -200,21 +206,21 @@ Status RPIServiceImpl::executeCommand(ServerContext* context, const std::string&
 Status RPIServiceImpl::replInterrupt(ServerContext*, const Empty*, Empty*) {
   if (replState == REPL_BUSY || isEventHandlerRunning()) {
     asyncInterrupt();
-    eventLoopExecute([] {});
+    eventLoopExecute([] {}, false, TaskPriority::INTERACTIVE);
   } else if (replState == READ_LINE) {
     eventLoopExecute([=] {
       if (replState == READ_LINE) {
         R_interrupts_pending = 1;
         breakEventLoop("");
       }
-    });
+    }, false, TaskPriority::INTERACTIVE);
   } else if (replState == SUBPROCESS_INPUT && subprocessActive) {
     eventLoopExecute([=] {
       if (replState == SUBPROCESS_INPUT && subprocessActive) {
         subprocessInterrupt = true;
         breakEventLoop("");
       }
-    });
+    }, false, TaskPriority::INTERACTIVE);
   }
   return Status::OK;
 }
@@ -236,7 +242,7 @@ Status RPIServiceImpl::sendReadLn(ServerContext*, const StringValue* request, Em
     } else if (replState == SUBPROCESS_INPUT && !text.empty()) {
       breakEventLoop(text);
     }
-  });
+  }, false, TaskPriority::INTERACTIVE);
   return Status::OK;
 }
 
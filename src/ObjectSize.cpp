@@ -0,0 +1,150 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "ObjectSize.h"
+#include <R_ext/Altrep.h>
+#include <unordered_set>
+#include <vector>
+
+extern "C" {
+LibExtern int R_interrupts_pending;
+}
+
+// Sizes of a cons cell and of a vector header on the current platform, as in memory.c
+static const long long NODE_SIZE = 7 * sizeof(void*);
+static const long long VECTOR_HEADER_SIZE = 6 * sizeof(void*);
+static const int CHECK_DEADLINE_PERIOD = 4096;
+
+// Small vectors are allocated in size classes
+static long long vectorSize(long long dataBytes) {
+  static const long long SMALL_VECTOR_SIZES[] = {8, 16, 32, 48, 64, 128};
+  if (dataBytes == 0) return VECTOR_HEADER_SIZE;
+  for (long long size : SMALL_VECTOR_SIZES) {
+    if (dataBytes <= size) return VECTOR_HEADER_SIZE + size;
+  }
+  return VECTOR_HEADER_SIZE + (dataBytes + 7) / 8 * 8;
+}
+
+static long long elementSize(int type) {
+  switch (type) {
+    case LGLSXP: return sizeof(int);
+    case INTSXP: return sizeof(int);
+    case REALSXP: return sizeof(double);
+    case CPLXSXP: return sizeof(Rcomplex);
+    case RAWSXP: return 1;
+    case STRSXP:
+    case VECSXP:
+    case EXPRSXP: return sizeof(SEXP);
+    default: return 0;
+  }
+}
+
+namespace {
+struct Frame {
+  SEXP x;
+  R_xlen_t next; // Index of the next element of a list or a character vector, -1 if `x` is not visited yet
+};
+}
+
+ObjectSize getObjectSize(SEXP x, std::chrono::steady_clock::time_point deadline) {
+  ObjectSize result;
+  std::unordered_set<SEXP> visited;
+  std::vector<Frame> stack = {{x, -1}};
+  int untilCheck = CHECK_DEADLINE_PERIOD;
+  auto push = [&](SEXP child) {
+    if (child != R_NilValue && !visited.count(child)) stack.push_back({child, -1});
+  };
+  while (!stack.empty()) {
+    if (--untilCheck == 0) {
+      untilCheck = CHECK_DEADLINE_PERIOD;
+      if (R_interrupts_pending || std::chrono::steady_clock::now() > deadline) {
+        result.isComplete = false;
+        break;
+      }
+    }
+    Frame &frame = stack.back();
+    SEXP cur = frame.x;
+    if (frame.next >= 0) {
+      // Elements are pushed one at a time, so that long vectors don't blow up the stack
+      if (frame.next == XLENGTH(cur)) {
+        stack.pop_back();
+      } else {
+        R_xlen_t i = frame.next++;
+        push(TYPEOF(cur) == STRSXP ? STRING_ELT(cur, i) : VECTOR_ELT(cur, i));
+      }
+      continue;
+    }
+    stack.pop_back();
+    if (!visited.insert(cur).second) continue;
+    int type = TYPEOF(cur);
+    // Symbols are global and shared by everything
+    if (type == SYMSXP) continue;
+    // Note: ATTRIB of a CHARSXP links it into the global string cache, it has no attributes
+    if (type != CHARSXP) push(ATTRIB(cur));
+    if (ALTREP(cur)) {
+      result.bytes += NODE_SIZE;
+      push(R_altrep_data1(cur));
+      push(R_altrep_data2(cur));
+      continue;
+    }
+    switch (type) {
+      case LISTSXP:
+      case LANGSXP:
+      case DOTSXP:
+      case PROMSXP:
+      case BCODESXP:
+        result.bytes += NODE_SIZE;
+        push(CAR(cur));
+        push(CDR(cur));
+        push(TAG(cur));
+        break;
+      case CLOSXP:
+        result.bytes += NODE_SIZE;
+        push(FORMALS(cur));
+        push(BODY(cur));
+        break;
+      case EXTPTRSXP:
+        result.bytes += NODE_SIZE;
+        push(R_ExternalPtrProtected(cur));
+        push(R_ExternalPtrTag(cur));
+        break;
+      case CHARSXP:
+        result.bytes += vectorSize(LENGTH(cur) + 1);
+        break;
+      case LGLSXP:
+      case INTSXP:
+      case REALSXP:
+      case CPLXSXP:
+      case RAWSXP:
+        result.bytes += vectorSize(elementSize(type) * XLENGTH(cur));
+        break;
+      case STRSXP:
+      case VECSXP:
+      case EXPRSXP:
+        result.bytes += vectorSize(elementSize(type) * XLENGTH(cur));
+        stack.push_back({cur, 0});
+        break;
+      case WEAKREFSXP:
+        result.bytes += vectorSize(4 * sizeof(SEXP));
+        break;
+      default:
+        // Environments (without their contents), primitives, S4 objects
+        result.bytes += NODE_SIZE;
+    }
+  }
+  return result;
+}
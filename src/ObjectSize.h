@@ -0,0 +1,35 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_OBJECT_SIZE_H
+#define RWRAPPER_OBJECT_SIZE_H
+
+#include "RStuff/RInclude.h"
+#include <chrono>
+
+struct ObjectSize {
+  long long bytes = 0;
+  bool isComplete = true; // If false, the time limit was reached or R was interrupted and `bytes` is a lower bound
+};
+
+// Estimates memory used by an object like utils::object.size does, but natively:
+// objects reachable in several ways are counted once, ALTREP objects are measured by their compact representation
+// without expanding them, and contents of environments are not included.
+// Must be called on the main thread
+ObjectSize getObjectSize(SEXP x, std::chrono::steady_clock::time_point deadline);
+
+#endif //RWRAPPER_OBJECT_SIZE_H
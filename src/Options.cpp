@@ -15,6 +15,7 @@
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "Options.h"
+#include <algorithm>
 
 CommandLineOptions commandLineOptions;
 
@@ -25,7 +26,13 @@ void CommandLineOptions::parse(int argc, char* argv[]) {
       ("with-timeout", "Terminate RWrapper if no RPCs were received for a minute")
       ("crash-report-file", "File for saving crash report", cxxopts::value<std::string>())
       ("is-remote", "RWrapper is run on a remote host")
-      ("disable-rprofile", "Don't run .Rprofile on startup");
+      ("disable-rprofile", "Don't run .Rprofile on startup")
+      ("data-frame-memory-limit", "Memory limit for data frames registered by the viewer in MB, 0 for no limit",
+       cxxopts::value<int>()->default_value("0"))
+      ("async-event-overflow", "What to do with output when the client doesn't keep up: block, coalesce or drop",
+       cxxopts::value<std::string>()->default_value("coalesce"))
+      ("output-budget", "Console output of one command sent to the client in MB, the rest is saved to a file. 0 for no limit",
+       cxxopts::value<int>()->default_value("64"));
   try {
     auto result = options.parse(argc, argv);
     if (result["help"].as<bool>()) {
@@ -35,6 +42,13 @@ void CommandLineOptions::parse(int argc, char* argv[]) {
     withTimeout = result["with-timeout"].as<bool>();
     isRemote = result["is-remote"].as<bool>();
     disableRprofile = result["disable-rprofile"].as<bool>();
+    dataFrameMemoryLimitMB = std::max(0, result["data-frame-memory-limit"].as<int>());
+    asyncEventOverflow = result["async-event-overflow"].as<std::string>();
+    outputBudgetMB = std::max(0, result["output-budget"].as<int>());
+    if (asyncEventOverflow != "block" && asyncEventOverflow != "coalesce" && asyncEventOverflow != "drop") {
+      std::cerr << "Invalid value of --async-event-overflow: " << asyncEventOverflow << "\n";
+      exit(1);
+    }
     if (result.count("crash-report-file")) {
       crashReportFile = result["crash-report-file"].as<std::string>();
     }
@@ -24,6 +24,9 @@ struct CommandLineOptions {
   std::string crashReportFile;
   bool isRemote = false;
   bool disableRprofile = false;
+  int dataFrameMemoryLimitMB = 0;
+  std::string asyncEventOverflow = "coalesce";
+  int outputBudgetMB = 64;
 
   void parse(int argc, char* argv[]);
 };
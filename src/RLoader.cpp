@@ -16,10 +16,15 @@
 
 #include "RPIServiceImpl.h"
 #include "RStuff/RUtil.h"
+#include "ObjectSize.h"
+#include "ValueInfoCache.h"
 #include "util/ContainerUtil.h"
 #include "util/StringUtil.h"
 #include <grpcpp/server_builder.h>
+#include <algorithm>
+#include <cstring>
 #include <limits>
+#include <vector>
 
 static const int MAX_PREVIEW_STRING_LENGTH = 400;
 static const int MAX_PREVIEW_CLS_LENGTH = 200;
@@ -32,7 +37,7 @@ static bool trim(std::string &s, int len = MAX_PREVIEW_STRING_LENGTH) {
   return false;
 }
 
-void getValueInfo(SEXP _var, ValueInfo* result) {
+static void computeValueInfo(SEXP _var, ValueInfo* result) {
   ShieldSEXP var = _var;
   try {
     auto type = var.type();
@@ -175,6 +180,30 @@ void getValueInfo(SEXP _var, ValueInfo* result) {
   }
 }
 
+void getValueInfo(SEXP var, ValueInfo* result) {
+  uint64_t hash;
+  if (!valueInfoCache.fingerprint(var, hash)) {
+    computeValueInfo(var, result);
+    return;
+  }
+  if (valueInfoCache.get(var, hash, result)) return;
+  computeValueInfo(var, result);
+  if (!result->has_error()) valueInfoCache.put(var, hash, *result);
+}
+
+// Sorts symbols the way ls() does. R compares names with its own collation (ICU in most builds),
+// which may differ from the C library one, so the order is computed by R
+static void sortSymbolsByCollation(std::vector<SEXP> &symbols) {
+  int count = (int)symbols.size();
+  ShieldSEXP names = Rf_allocVector(STRSXP, count);
+  for (int i = 0; i < count; ++i) SET_STRING_ELT(names, i, PRINTNAME(symbols[i]));
+  std::vector<int> order(count);
+  R_orderVector1(order.data(), count, names, TRUE, FALSE);
+  std::vector<SEXP> sorted(count);
+  for (int i = 0; i < count; ++i) sorted[i] = symbols[order[i]];
+  symbols.swap(sorted);
+}
+
 Status RPIServiceImpl::loaderGetParentEnvs(ServerContext* context, const RRef* request, ParentEnvsResponse* response) {
   executeOnMainThread([&] {
     PrSEXP environment = dereference(*request);
@@ -195,7 +224,7 @@ Status RPIServiceImpl::loaderGetParentEnvs(ServerContext* context, const RRef* r
 }
 
 Status RPIServiceImpl::loaderGetVariables(ServerContext* context, const GetVariablesRequest* request, VariablesResponse* response) {
-  executeOnMainThread([&] {
+  executeCoalescedOnMainThread(getVariablesCoalescer, *request, response, context, [&] {
     ShieldSEXP obj = dereference(request->obj());
     R_xlen_t reqStart = request->start();
     R_xlen_t reqEnd = request->end();
@@ -203,35 +232,29 @@ Status RPIServiceImpl::loaderGetVariables(ServerContext* context, const GetVaria
     if (obj.type() == ENVSXP) {
       response->set_isenv(true);
       if (request->onlyfunctions() && request->nofunctions()) return;
-      ShieldSEXP ls = RI->ls(named("envir", obj), named("all.names", !request->nohidden()));
-      if (ls.type() != STRSXP) return;
-      R_xlen_t length = ls.length();
+      std::vector<SEXP> symbols;
+      forEachBindingSymbol(obj, !request->nohidden(), [&](SEXP symbol) { symbols.push_back(symbol); });
       if (request->onlyfunctions() || request->nofunctions()) {
-        R_xlen_t j = 0;
-        for (R_xlen_t i = 0; i < length; ++i) {
-          ShieldSEXP x = obj.getVar(stringEltNative(ls, i), false);
-          bool isFunc = x.type() == CLOSXP || x.type() == BUILTINSXP || x.type() == SPECIALSXP;
-          if (isFunc == request->onlyfunctions()) {
-            if (reqStart <= j && j < reqEnd) {
-              VariablesResponse::Variable *var = response->add_vars();
-              std::string name = stringEltUTF8(ls, i);
-              trim(name);
-              var->set_name(name);
-              getValueInfo(x, var->mutable_value());
-            }
-            ++j;
-          }
-        }
-        response->set_totalcount(j);
-      } else {
-        response->set_totalcount(ls.length());
-        for (int i = std::max<R_xlen_t>(0, reqStart); i < std::min(length, reqEnd); ++i) {
-          VariablesResponse::Variable *var = response->add_vars();
-          std::string name = stringEltUTF8(ls, i);
-          trim(name);
-          var->set_name(name);
-          getValueInfo(obj.getVar(stringEltNative(ls, i), false), var->mutable_value());
-        }
+        auto end = std::remove_if(symbols.begin(), symbols.end(), [&](SEXP symbol) {
+          SEXP x = Rf_findVarInFrame(obj, symbol);
+          bool isFunc = TYPEOF(x) == CLOSXP || TYPEOF(x) == BUILTINSXP || TYPEOF(x) == SPECIALSXP;
+          return isFunc != request->onlyfunctions();
+        });
+        symbols.erase(end, symbols.end());
+      }
+      R_xlen_t length = symbols.size();
+      response->set_totalcount(length);
+      reqStart = std::max<R_xlen_t>(0, reqStart);
+      reqEnd = std::min(length, reqEnd);
+      if (reqStart >= reqEnd) return;
+      sortSymbolsByCollation(symbols);
+      for (R_xlen_t i = reqStart; i < reqEnd; ++i) {
+        VariablesResponse::Variable *var = response->add_vars();
+        std::string name = asStringUTF8(PRINTNAME(symbols[i]));
+        trim(name);
+        var->set_name(name);
+        SEXP x = Rf_findVarInFrame(obj, symbols[i]);
+        getValueInfo(x == R_UnboundValue ? R_NilValue : x, var->mutable_value());
       }
       return;
     }
@@ -271,7 +294,7 @@ Status RPIServiceImpl::loaderGetVariables(ServerContext* context, const GetVaria
       var->set_name(name);
       getValueInfo(RI->doubleSubscript(filtered, i + 1), var->mutable_value());
     }
-  }, context, true);
+  });
   return Status::OK;
 }
 
@@ -291,7 +314,7 @@ Status RPIServiceImpl::loaderGetLoadedNamespaces(ServerContext* context, const E
 }
 
 Status RPIServiceImpl::loaderGetValueInfo(ServerContext* context, const RRef* request, ValueInfo* response) {
-  executeOnMainThread([&] {
+  executeCoalescedOnMainThread(getValueInfoCoalescer, *request, response, context, [&] {
     try {
       getValueInfo(dereference(*request), response);
     } catch (RExceptionBase const& e) {
@@ -300,16 +323,21 @@ Status RPIServiceImpl::loaderGetValueInfo(ServerContext* context, const RRef* re
       response->mutable_error()->set_text("Error");
       throw;
     }
-  }, context, true);
+  });
   return Status::OK;
 }
 
+// Sizes that take longer are reported as unknown (-1)
+static const int OBJECT_SIZES_TIME_LIMIT_MS = 1000;
+
 Status RPIServiceImpl::getObjectSizes(ServerContext* context, const RRefList* request, Int64List* response) {
   executeOnMainThread([&] {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(OBJECT_SIZES_TIME_LIMIT_MS);
     for (RRef const& ref : request->refs()) {
       long long size;
       try {
-        size = asInt64OrError(RI->objectSize(Rf_lang2(RI->quote, dereference(ref))));
+        auto objectSize = getObjectSize(dereference(ref), deadline);
+        size = objectSize.isComplete ? objectSize.bytes : -1;
       } catch (RInterruptedException const&) {
         throw;
       } catch (RExceptionBase const&) {
@@ -24,6 +24,7 @@
 #include "util/ScopedAssign.h"
 #include "util/StringUtil.h"
 #include "util/FileUtil.h"
+#include "util/Finally.h"
 #include "graphics/DeviceManager.h"
 #include "graphics/SnapshotUtil.h"
 #include "graphics/Evaluator.h"
@@ -223,9 +224,13 @@ namespace {
   }
 
   void fillMessage(rplugininterop::Polyline* message, const graphics::Polyline& polyline) {
+    // Note: polylines of scatter plots have hundreds of thousands of points,
+    // so the storage is allocated once instead of growing with every point
     auto pointCount = polyline.points.size();
+    auto points = message->mutable_point();
+    points->Reserve(int(pointCount));
     for (auto i = 0U; i < pointCount; i++) {
-      message->add_point(packPoint(polyline.points[i], polyline.previewMask[i]));
+      points->AddAlreadyReserved(packPoint(polyline.points[i], polyline.previewMask[i]));
     }
     message->set_previewcount(polyline.previewCount);
   }
@@ -289,6 +294,7 @@ namespace {
 
   PathFigure* createMessage(const graphics::PathFigure& path) {
     auto message = new PathFigure();
+    message->mutable_subpath()->Reserve(int(path.getSubPaths().size()));
     for (const auto& subPath : path.getSubPaths()) {
       auto subPathMessage = message->add_subpath();
       fillMessage(subPathMessage, subPath);
@@ -394,6 +400,7 @@ namespace {
     message->set_clippingareaindex(layer.clippingAreaIndex);
     message->set_viewportindex(layer.viewportIndex);
     message->set_isaxistext(layer.isAxisText);
+    message->mutable_figure()->Reserve(int(layer.figures.size()));
     for (const auto& figure : layer.figures) {
       auto figureMessage = message->add_figure();
       fillMessage(figureMessage, *figure);
@@ -402,21 +409,27 @@ namespace {
 
   Plot* createMessage(const graphics::Plot& plot) {
     auto message = new Plot();
+    message->mutable_font()->Reserve(int(plot.fonts.size()));
     for (const auto& font : plot.fonts) {
       auto fontMessage = message->add_font();
       fillMessage(fontMessage, font);
     }
+    auto colors = message->mutable_color();
+    colors->Reserve(int(plot.colors.size()));
     for (const auto& color : plot.colors) {
-      message->add_color(color.value);
+      colors->AddAlreadyReserved(color.value);
     }
+    message->mutable_stroke()->Reserve(int(plot.strokes.size()));
     for (const auto& stroke : plot.strokes) {
       auto strokeMessage = message->add_stroke();
       fillMessage(strokeMessage, stroke);
     }
+    message->mutable_viewport()->Reserve(int(plot.viewports.size()));
     for (const auto& viewport : plot.viewports) {
       auto viewportMessage = message->add_viewport();
       fillMessage(viewportMessage, *viewport);
     }
+    message->mutable_layer()->Reserve(int(plot.layers.size()));
     for (const auto& layer : plot.layers) {
       auto layerMessage = message->add_layer();
       fillMessage(layerMessage, layer);
@@ -428,12 +441,34 @@ namespace {
   }
 }
 
+static const size_t ASYNC_EVENT_QUEUE_CAPACITY = 1024;
+static const size_t OUTPUT_ARENA_CAPACITY = 1 << 20;
+static const int GRAPHICS_DEBOUNCE_MS = 50;
+
+static Status supersededStatus() {
+  return Status(grpc::StatusCode::CANCELLED, "superseded");
+}
+
+// Text events in the queue only wake up the consumer to drain the output arena
+static bool isOutputMarker(QueuedAsyncEvent const& e) {
+  return e.event.has_text();
+}
+
 RPIServiceImpl::RPIServiceImpl() :
   replOutputHandler([&](const char* buf, int len, OutputType type) {
-    AsyncEvent event;
-    event.mutable_text()->set_type(type == STDOUT ? CommandOutput::STDOUT : CommandOutput::STDERR);
-    event.mutable_text()->set_text(buf, len);
-    asyncEvents.push(event);
+    outputArena.append(buf, len, type);
+  }),
+  cancellationWatcher(std::chrono::milliseconds(25)),
+  asyncEvents(ASYNC_EVENT_QUEUE_CAPACITY,
+              [](QueuedAsyncEvent &last, QueuedAsyncEvent const& e) {
+                if (!isOutputMarker(last) || !isOutputMarker(e)) return false;
+                last.outputPosition = e.outputPosition;
+                return true;
+              }),
+  outputArena(OUTPUT_ARENA_CAPACITY, OUTPUT_FLUSH_THRESHOLD, [&] {
+    QueuedAsyncEvent marker;
+    marker.event.mutable_text();
+    pushAsyncEvent(marker);
   }) {
   std::cerr << "rpi service impl constructor\n";
 }
@@ -445,7 +480,7 @@ void RPIServiceImpl::writeToReplOutputHandler(std::string const& s, OutputType t
 }
 
 void RPIServiceImpl::sendAsyncRequestAndWait(AsyncEvent const& e) {
-  asyncEvents.push(e);
+  sendAsyncEvent(e);
   ScopedAssign<bool> with(isInClientRequest, true);
   runEventLoop();
 }
@@ -492,7 +527,8 @@ Status RPIServiceImpl::graphicsRescale(ServerContext* context, const GraphicsRes
     std::to_string(request->newparameters().resolution()),
   };
   auto command = buildCallCommand(".Call", joinToString(arguments));
-  return executeCommand(context, command, writer);
+  auto key = "rescale:" + std::to_string(request->snapshotnumber());
+  return executeDebouncedCommand(context, key, command, writer);
 }
 
 Status RPIServiceImpl::graphicsRescaleStored(ServerContext* context, const GraphicsRescaleStoredRequest* request, ServerWriter<CommandOutput>* writer) {
@@ -511,11 +547,35 @@ Status RPIServiceImpl::graphicsRescaleStored(ServerContext* context, const Graph
   auto numberArguments = joinToString(numbers, [](int n) { return std::to_string(n); });
   auto arguments = joinToString(std::vector<std::string> { stringArguments, numberArguments });
   auto command = buildCallCommand(".Call", arguments);
-  return executeCommand(context, command, writer);
+  auto key = "rescaleStored:" + request->groupid() + ":" + std::to_string(request->snapshotnumber());
+  return executeDebouncedCommand(context, key, command, writer);
+}
+
+Status RPIServiceImpl::executeDebouncedCommand(ServerContext* context, std::string const& key, const std::string& command,
+                                               ServerWriter<CommandOutput>* writer) {
+  // Note: an obsolete request is cancelled, the client gets the result of the newer one.
+  // Only bursts are delayed, an isolated request is executed right away.
+  // A replay that has already started is not interrupted since it would leave a truncated snapshot
+  bool isBurst;
+  auto ticket = graphicsDebouncer.submit(key, isBurst);
+  auto finally = Finally { [&] { graphicsDebouncer.finish(key); } };
+  if (isBurst && !graphicsDebouncer.wait(key, ticket, std::chrono::milliseconds(GRAPHICS_DEBOUNCE_MS))) {
+    return supersededStatus();
+  }
+  bool isSuperseded = false;
+  auto status = executeCommand(context, command, writer, [&] {
+    return isSuperseded = !graphicsDebouncer.isLatest(key, ticket);
+  });
+  return isSuperseded ? supersededStatus() : status;
 }
 
 Status RPIServiceImpl::graphicsSetParameters(ServerContext* context, const ScreenParameters* request, Empty*) {
+  std::string key = "setParameters";
+  bool isBurst;
+  auto ticket = graphicsDebouncer.submit(key, isBurst);
+  auto finally = Finally { [&] { graphicsDebouncer.finish(key); } };
   executeOnMainThread([&] {
+    if (!graphicsDebouncer.isLatest(key, ticket)) return;
     auto active = graphics::DeviceManager::getInstance()->getActive();
     if (active != nullptr && active->isOnlineRescalingEnabled()) {
       auto size = graphics::Size{double(request->width()), double(request->height())};
@@ -554,15 +614,23 @@ Status RPIServiceImpl::graphicsGetSnapshotPath(ServerContext* context, const Gra
 }
 
 Status RPIServiceImpl::graphicsFetchPlot(ServerContext* context, const Int32Value* request, GraphicsFetchPlotResponse* response) {
-  executeOnMainThread([&] {
-    try {
-      auto active = getActiveDeviceOrThrow();
-      auto plot = active->fetchPlot(request->value());
-      response->set_allocated_plot(createMessage(plot));
-    } catch (const std::exception& e) {
-      response->set_message(e.what());
-    }
-  }, context);
+  // Only replaying needs R, the message is built on the gRPC thread.
+  // A plot that has been fetched already is sent without waiting for R, even if it's busy.
+  // The plot is shared with the device's cache and is never modified, so it isn't copied
+  auto plot = graphics::MasterDevice::getPublishedPlot(request->value());
+  if (plot == nullptr) {
+    executeOnMainThread([&] {
+      try {
+        auto active = getActiveDeviceOrThrow();
+        plot = active->fetchPlot(request->value());
+      } catch (const std::exception& e) {
+        response->set_message(e.what());
+      }
+    }, context);
+  }
+  if (plot != nullptr) {
+    response->set_allocated_plot(createMessage(*plot));
+  }
   return Status::OK;
 }
 
@@ -677,7 +745,7 @@ Status RPIServiceImpl::commitDataImport(ServerContext* context, const CommitData
 void RPIServiceImpl::mainLoop() {
   AsyncEvent event;
   event.mutable_prompt();
-  asyncEvents.push(event);
+  sendAsyncEvent(event);
   ScopedAssign<ReplState> withState(replState, PROMPT);
   WithOutputHandler withOutputHandler(replOutputHandler);
 #pragma clang diagnostic push
@@ -693,7 +761,7 @@ void RPIServiceImpl::mainLoop() {
     rDebugger.clearSavedStack();
     if (replState != PROMPT) {
       event.mutable_prompt();
-      asyncEvents.push(event);
+      sendAsyncEvent(event);
       replState = PROMPT;
     }
   }
@@ -705,10 +773,24 @@ void RPIServiceImpl::setChildProcessState() {
 }
 
 void RPIServiceImpl::sendAsyncEvent(AsyncEvent const& e) {
-  asyncEvents.push(e);
+  QueuedAsyncEvent queued;
+  queued.event = e;
+  pushAsyncEvent(queued);
 }
 
-void RPIServiceImpl::executeOnMainThread(std::function<void()> const& f, ServerContext* context, bool immediate) {
+void RPIServiceImpl::pushAsyncEvent(QueuedAsyncEvent& queued) {
+  std::unique_lock<std::mutex> lock(asyncEventsMutex);
+  queued.outputPosition = outputArena.position();
+  asyncEvents.push(queued);
+}
+
+uint64_t RPIServiceImpl::getQueuedOutputPosition() {
+  std::unique_lock<std::mutex> lock(asyncEventsMutex);
+  return outputArena.position();
+}
+
+void RPIServiceImpl::executeOnMainThread(std::function<void()> const& f, ServerContext* context, bool immediate,
+                                         TaskPriority priority) {
   static const int STATE_PENDING = 0;
   static const int STATE_RUNNING = 1;
   static const int STATE_INTERRUPTING = 2;
@@ -718,8 +800,20 @@ void RPIServiceImpl::executeOnMainThread(std::function<void()> const& f, ServerC
   std::mutex mutex;
   std::unique_lock<std::mutex> lock(mutex);
   std::condition_variable condVar;
+  auto startTime = std::chrono::steady_clock::now();
+  TaskOptions options(priority);
+  // A request whose client has already given up is not worth starting
+  if (context != nullptr && context->deadline() != std::chrono::system_clock::time_point::max()) {
+    options.deadline = startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        context->deadline() - std::chrono::system_clock::now());
+  }
+  options.onDrop = [&] {
+    std::unique_lock<std::mutex> lock1(mutex);
+    int expected = STATE_PENDING;
+    if (state.compare_exchange_strong(expected, STATE_DONE)) condVar.notify_all();
+  };
 
-  eventLoopExecute([&] {
+  uint64_t taskId = eventLoopExecute([&] {
     R_interrupts_pending = 0;
     int expected = STATE_PENDING;
     if (!state.compare_exchange_strong(expected, STATE_RUNNING)) return;
@@ -730,7 +824,7 @@ void RPIServiceImpl::executeOnMainThread(std::function<void()> const& f, ServerC
         condVar.wait(lock1, [&] { return state.load() == STATE_INTERRUPTED; });
       }
       state.store(STATE_DONE);
-      condVar.notify_one();
+      condVar.notify_all();
       R_interrupts_pending = 0;
     }};
     try {
@@ -742,22 +836,36 @@ void RPIServiceImpl::executeOnMainThread(std::function<void()> const& f, ServerC
     } catch (...) {
       std::cerr << "Exception: unknown\n";
     }
-  }, immediate);
-  bool cancelled = false;
-  while (!terminateProceed) {
-    int currentState = state.load();
-    if (currentState == STATE_DONE) break;
-    if (currentState == STATE_RUNNING && !cancelled && context != nullptr && context->IsCancelled()) {
-      int expected = STATE_RUNNING;
-      if (state.compare_exchange_strong(expected, STATE_INTERRUPTING)) {
-        cancelled = true;
-        asyncInterrupt();
-        state.store(STATE_INTERRUPTED);
-        condVar.notify_one();
-      }
+  }, immediate, options);
+  // Completion is signalled by the task itself, cancellation is detected by the shared watcher thread
+  int watchId = cancellationWatcher.add([&] {
+    if (terminateProceed) {
+      std::unique_lock<std::mutex> lock1(mutex);
+      condVar.notify_all();
+      return true;
     }
-    condVar.wait_for(lock, std::chrono::milliseconds(25));
-  }
+    if (context == nullptr || !context->IsCancelled()) return false;
+    if (state.load() == STATE_PENDING) {
+      // A request cancelled before it started is dropped, unless the main thread has just taken it
+      if (!eventLoopCancel(taskId, immediate)) return false;
+      std::unique_lock<std::mutex> lock1(mutex);
+      state.store(STATE_DONE);
+      condVar.notify_all();
+      return true;
+    }
+    int expected = STATE_RUNNING;
+    if (state.compare_exchange_strong(expected, STATE_INTERRUPTING)) {
+      asyncInterrupt();
+      std::unique_lock<std::mutex> lock1(mutex);
+      state.store(STATE_INTERRUPTED);
+      condVar.notify_all();
+    }
+    return true;
+  });
+  condVar.wait(lock, [&] { return terminateProceed || state.load() == STATE_DONE; });
+  lock.unlock();
+  cancellationWatcher.remove(watchId);
+  mainThreadLatency.add(std::chrono::steady_clock::now() - startTime);
 }
 
 std::unique_ptr<RPIServiceImpl> rpiService;
@@ -820,6 +928,10 @@ private:
 
 TerminationTimer* terminationTimer;
 
+static const int SERVER_COMPLETION_QUEUES = 2;
+static const int SERVER_MIN_POLLERS = 2;
+static const int SERVER_MAX_POLLERS = 8;
+
 void initRPIService() {
   rpiService = std::make_unique<RPIServiceImpl>();
   if (commandLineOptions.withTimeout) {
@@ -827,6 +939,10 @@ void initRPIService() {
     terminationTimer->init();
   }
   ServerBuilder builder;
+  // Keep enough pollers so that requests that don't need R are accepted while other handlers wait for the main thread
+  builder.SetSyncServerOption(ServerBuilder::SyncServerOption::NUM_CQS, SERVER_COMPLETION_QUEUES);
+  builder.SetSyncServerOption(ServerBuilder::SyncServerOption::MIN_POLLERS, SERVER_MIN_POLLERS);
+  builder.SetSyncServerOption(ServerBuilder::SyncServerOption::MAX_POLLERS, SERVER_MAX_POLLERS);
   int port = 0;
   builder.AddListeningPort("127.0.0.1:0", InsecureServerCredentials(), &port);
   builder.RegisterService(rpiService.get());
@@ -842,7 +958,7 @@ void quitRPIService() {
   rpiService->terminate = true;
   AsyncEvent event;
   event.mutable_termination();
-  rpiService->asyncEvents.push(event);
+  rpiService->sendAsyncEvent(event);
   for (int iter = 0; iter < 100 && !rpiService->terminateProceed; ++iter) {
     std::this_thread::sleep_for(std::chrono::milliseconds(25));
   }
@@ -21,8 +21,16 @@
 #include "protos/service.grpc.pb.h"
 #include <string>
 #include <functional>
-#include "util/BlockingQueue.h"
+#include <mutex>
+#include <vector>
+#include "util/CancellationWatcher.h"
+#include "util/Debouncer.h"
 #include "util/IndexedStorage.h"
+#include "util/LatencyHistogram.h"
+#include "util/MPSCQueue.h"
+#include "util/OutputArena.h"
+#include "util/RequestCoalescer.h"
+#include "util/TaskScheduler.h"
 #include "IO.h"
 #include "Options.h"
 #include "debugger/RDebugger.h"
@@ -35,6 +43,13 @@ using namespace rplugininterop;
 using namespace classes;
 using namespace google::protobuf;
 
+struct QueuedAsyncEvent {
+  uint64_t outputPosition = 0; // Console output before this position is sent before the event
+  AsyncEvent event;
+};
+
+const size_t OUTPUT_FLUSH_THRESHOLD = 200000;
+
 class RPIServiceImpl : public RPIService::Service {
 public:
   RPIServiceImpl();
@@ -166,7 +181,9 @@ public:
   volatile bool terminate = false;
   volatile bool terminateProceed = false;
 
-  void executeOnMainThread(std::function<void()> const& f, ServerContext* contextForCancellation = nullptr, bool immediate = false);
+  void executeOnMainThread(std::function<void()> const& f, ServerContext* contextForCancellation = nullptr, bool immediate = false,
+                           TaskPriority priority = TaskPriority::UI);
+  LatencyHistogram mainThreadLatency; // Time from submitting a task in executeOnMainThread to its completion
 
   OutputHandler getOutputHandlerForChildProcess();
 
@@ -179,7 +196,42 @@ public:
   IndexedStorage<PrSEXP> persistentRefStorage;
 
 private:
-  BlockingQueue<AsyncEvent> asyncEvents;
+  CancellationWatcher cancellationWatcher;
+  MPSCQueue<QueuedAsyncEvent> asyncEvents;
+  OutputArena outputArena; // Console output, sent to the client along with asyncEvents
+  // Stamping an event with the output position and queueing it is atomic, so the queue is ordered by positions.
+  // Pushing never blocks since the queue doesn't use the BLOCK policy
+  std::mutex asyncEventsMutex;
+  void pushAsyncEvent(QueuedAsyncEvent& queued);
+  // Output before the returned position can be sent once the events queued so far are sent
+  uint64_t getQueuedOutputPosition();
+
+  // Identical inspector requests that are in flight at the same time are evaluated once
+  RequestCoalescer<VariablesResponse> getVariablesCoalescer;
+  RequestCoalescer<ValueInfo> getValueInfoCoalescer;
+  RequestCoalescer<StringOrError> evaluateAsTextCoalescer;
+
+  template <typename Request, typename Response>
+  void executeCoalescedOnMainThread(RequestCoalescer<Response>& coalescer, Request const& request, Response* response,
+                                    ServerContext* context, std::function<void()> const& f) {
+    int watchId = cancellationWatcher.add([&] {
+      if (!context->IsCancelled()) return false;
+      coalescer.wakeWaiters();
+      return true;
+    });
+    coalescer.execute(request.SerializeAsString(), response, [&](Response*) {
+      executeOnMainThread(f, context, true);
+      return !context->IsCancelled();
+    }, [&] { return context->IsCancelled(); });
+    cancellationWatcher.remove(watchId);
+  }
+
+  // Rescaling requests for the same snapshot arrive in bursts while the plot pane is resized,
+  // only the latest one is executed
+  Debouncer graphicsDebouncer;
+
+  Status executeDebouncedCommand(ServerContext* context, std::string const& key, const std::string& command,
+                                 ServerWriter<CommandOutput>* writer);
 
   enum ReplState {
     PROMPT, DEBUG_PROMPT, READ_LINE, REPL_BUSY, CHILD_PROCESS, SUBPROCESS_INPUT
@@ -195,7 +247,9 @@ private:
 
   std::vector<RDebuggerStackFrame> lastErrorStack;
 
-  Status executeCommand(ServerContext* context, const std::string& command, ServerWriter<CommandOutput>* writer);
+  // `isObsolete` is checked on the main thread right before the command is executed
+  Status executeCommand(ServerContext* context, const std::string& command, ServerWriter<CommandOutput>* writer,
+                        std::function<bool()> const& isObsolete = nullptr);
 
   Status replExecuteCommand(ServerContext* context, const std::string& command);
 
@@ -23,8 +23,11 @@
 #include "RStuff/RUtil.h"
 #include "Session.h"
 #include "Timer.h"
+#include "util/OutputGovernor.h"
 #include "util/StringUtil.h"
 #include <grpcpp/server_builder.h>
+#include <memory>
+#include <mutex>
 #include <signal.h>
 
 static RObject rStudioResponse;
@@ -34,11 +37,27 @@ static std::string getRVersion() {
          asStringUTF8(RI->doubleSubscript(RI->version, "minor"));
 }
 
+// The info doesn't change, so it is computed once and later requests don't wait for the main thread
 Status RPIServiceImpl::getInfo(ServerContext* context, const Empty*, GetInfoResponse* response) {
+  static std::mutex mutex;
+  static std::unique_ptr<GetInfoResponse> cachedInfo;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (cachedInfo != nullptr) {
+      response->CopyFrom(*cachedInfo);
+      return Status::OK;
+    }
+  }
+  bool done = false;
   executeOnMainThread([&] {
     response->set_rversion(getRVersion());
     response->set_pid(asInt(RI->sysGetPid()));
+    done = true;
   }, context);
+  if (done) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (cachedInfo == nullptr) cachedInfo = std::make_unique<GetInfoResponse>(*response);
+  }
   return Status::OK;
 }
 
@@ -278,20 +297,20 @@ void RPIServiceImpl::showHelpHandler(std::string const& content, std::string con
   event.mutable_showhelprequest()->set_success(true);
   event.mutable_showhelprequest()->set_content(content);
   event.mutable_showhelprequest()->set_url(url);
-  asyncEvents.push(event);
+  sendAsyncEvent(event);
 }
 
 void RPIServiceImpl::browseURLHandler(const std::string &url) {
   AsyncEvent event;
   event.set_browseurlrequest(url);
-  asyncEvents.push(event);
+  sendAsyncEvent(event);
 }
 
 RObject RPIServiceImpl::rStudioApiRequest(int32_t functionID, const RObject &args) {
   AsyncEvent event;
   event.mutable_rstudioapirequest()->set_functionid(functionID);
   event.mutable_rstudioapirequest()->set_allocated_args(new RObject(args));
-  asyncEvents.push(event);
+  sendAsyncEvent(event);
   ScopedAssign<bool> with(isInRStudioApiRequest, true);
   int timeout;
   if ((functionID < 8 || functionID > 15) && functionID != DOCUMENT_NEW_ID) {
@@ -330,44 +349,73 @@ Status RPIServiceImpl::rStudioApiResponse(ServerContext* context, const RObject*
   return Status::OK;
 }
 
-static const int CACHED_TEXT_LENGTH_LIMIT = 200000;
-static const auto ASYNC_EVENT_TIMEOUT = std::chrono::milliseconds(60);
+static const size_t OUTPUT_TAIL_SIZE = 64 * 1024;
 
 Status RPIServiceImpl::getAsyncEvents(ServerContext* context, const Empty*, ServerWriter<AsyncEvent>* writer) {
-  asyncEvents.setMaxSize(8);
-  auto deadline = std::chrono::steady_clock::now() + ASYNC_EVENT_TIMEOUT;
-  std::string cachedText;
-  CommandOutput_Type cachedTextType = CommandOutput_Type_STDOUT;
-  auto flushCachedText = [&] {
-    deadline = std::chrono::steady_clock::now() + ASYNC_EVENT_TIMEOUT;
-    if (cachedText.empty()) return;
-    AsyncEvent event;
-    event.mutable_text()->set_text(std::move(cachedText));
-    event.mutable_text()->set_type(cachedTextType);
-    cachedText = "";
-    writer->Write(event);
+  if (commandLineOptions.asyncEventOverflow == "block") {
+    outputArena.setOverflowPolicy(OutputArena::OverflowPolicy::BLOCK);
+  } else if (commandLineOptions.asyncEventOverflow == "drop") {
+    outputArena.setOverflowPolicy(OutputArena::OverflowPolicy::DROP);
+  } else {
+    outputArena.setOverflowPolicy(OutputArena::OverflowPolicy::GROW);
+  }
+  // Text messages are built only here, one message is reused for all chunks
+  AsyncEvent textEvent;
+  OutputGovernor governor((size_t)commandLineOptions.outputBudgetMB << 20, OUTPUT_TAIL_SIZE, STDERR,
+                          [&](int type, const char* data, size_t length) {
+    while (length > 0) {
+      // Note: protobuf strings must be valid UTF-8, so a multibyte character is never split between messages
+      size_t chunkLength = utf8BoundaryBefore(data, length, OUTPUT_FLUSH_THRESHOLD);
+      if (chunkLength == 0) chunkLength = std::min(length, OUTPUT_FLUSH_THRESHOLD);
+      textEvent.mutable_text()->set_type(type == STDERR ? CommandOutput_Type_STDERR : CommandOutput_Type_STDOUT);
+      textEvent.mutable_text()->set_text(data, chunkLength);
+      writer->Write(textEvent);
+      data += chunkLength;
+      length -= chunkLength;
+    }
+  });
+  auto writeText = [&](int type, const char* data, size_t length) {
+    governor.write(type, data, length);
+  };
+  auto deadline = std::chrono::steady_clock::now() + governor.flushInterval();
+  long long reportedDropped = outputArena.getDroppedBytes();
+  // Output is never sent past the position of an event that hasn't been sent yet.
+  // Events are queued in the order of their positions, so it's enough to drain up to the position of the popped event,
+  // or, if nothing was queued, up to the position taken before waiting
+  auto flushOutput = [&](uint64_t upTo, bool reportDropped) {
+    outputArena.drain(upTo, writeText);
+    deadline = std::chrono::steady_clock::now() + governor.flushInterval();
+    long long dropped = outputArena.getDroppedBytes();
+    if (!reportDropped || dropped == reportedDropped) return;
+    std::string notice = "\n[" + std::to_string(dropped - reportedDropped) + " bytes of output dropped]\n";
+    writeText(STDERR, notice.c_str(), notice.size());
+    reportedDropped = dropped;
+  };
+  auto processEvent = [&](QueuedAsyncEvent const& queued) {
+    if (queued.event.has_text()) {
+      flushOutput(queued.outputPosition, true);
+    } else {
+      flushOutput(queued.outputPosition, false);
+      if (queued.event.has_prompt() || queued.event.has_debugprompt()) governor.endSession();
+      writer->Write(queued.event);
+    }
   };
 
-  AsyncEvent event;
+  QueuedAsyncEvent queued;
   while (!context->IsCancelled() && !terminateProceed) {
-    if (asyncEvents.popWithDeadline(deadline, event)) {
-      if (event.has_text()) {
-        if (event.text().type() != cachedTextType) {
-          flushCachedText();
-          cachedTextType = event.text().type();
-        }
-        cachedText += event.text().text();
-        if (cachedText.length() > CACHED_TEXT_LENGTH_LIMIT) {
-          flushCachedText();
-        }
-      } else {
-        flushCachedText();
-        writer->Write(event);
-      }
+    uint64_t queuedPosition = getQueuedOutputPosition();
+    if (asyncEvents.popWithDeadline(deadline, queued)) {
+      processEvent(queued);
     } else {
-      flushCachedText();
+      flushOutput(queuedPosition, true);
     }
   }
-  flushCachedText();
+  // On shutdown the remaining events and output are sent in order.
+  // If the client has gone, they are left for the next call
+  if (terminateProceed) {
+    while (asyncEvents.poll(queued)) processEvent(queued);
+    flushOutput(UINT64_MAX, true);
+  }
+  governor.endSession();
   return Status::OK;
 }
@@ -105,7 +105,7 @@ Status RPIServiceImpl::disposePersistentRefs(ServerContext*, const PersistentRef
 }
 
 Status RPIServiceImpl::evaluateAsText(ServerContext* context, const RRef* request, StringOrError* response) {
-  executeOnMainThread([&] {
+  executeCoalescedOnMainThread(evaluateAsTextCoalescer, *request, response, context, [&] {
     try {
       PrSEXP value = dereference(*request);
       if (value.type() == STRSXP) {
@@ -118,7 +118,7 @@ Status RPIServiceImpl::evaluateAsText(ServerContext* context, const RRef* reques
       response->set_error("");
       throw;
     }
-  }, context, true);
+  });
   return Status::OK;
 }
 
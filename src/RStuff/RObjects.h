@@ -128,6 +128,7 @@ struct RObjects2 {
   PrSEXP vectorNot = baseEnv.getVar("!");
   PrSEXP vectorOr = baseEnv.getVar("|");
   PrSEXP withVisible = baseEnv.getVar("withVisible");
+  PrSEXP xtfrm = baseEnv.getVar("xtfrm");
 
   PrSEXP compiler = loadNamespace("compiler");
   PrSEXP compilerEnableJIT = compiler.getVar("enableJIT");
@@ -400,6 +400,31 @@ inline void walkObjects(Func const& f, SEXP x) {
   walkObjectsImpl(f, visited, x);
 }
 
+// Calls f(symbol) for each binding in the frame of `env` in no particular order.
+// The base environment keeps its bindings in the symbol table, so it is enumerated with ls()
+template<class Func>
+inline void forEachBindingSymbol(SEXP env, bool allNames, Func const& f) {
+  if (TYPEOF(env) != ENVSXP || env == R_EmptyEnv) return;
+  auto visit = [&](SEXP symbol) {
+    if (allNames || CHAR(PRINTNAME(symbol))[0] != '.') f(symbol);
+  };
+  if (env == R_BaseEnv || env == R_BaseNamespace) {
+    ShieldSEXP names = R_lsInternal3(env, allNames ? TRUE : FALSE, FALSE);
+    R_xlen_t length = Rf_xlength(names);
+    for (R_xlen_t i = 0; i < length; ++i) visit(Rf_installTrChar(STRING_ELT(names, i)));
+    return;
+  }
+  SEXP table = HASHTAB(env);
+  if (table != R_NilValue) {
+    R_xlen_t size = Rf_xlength(table);
+    for (R_xlen_t i = 0; i < size; ++i) {
+      for (SEXP chain = VECTOR_ELT(table, i); chain != R_NilValue; chain = CDR(chain)) visit(TAG(chain));
+    }
+  } else {
+    for (SEXP frame = FRAME(env); frame != R_NilValue; frame = CDR(frame)) visit(TAG(frame));
+  }
+}
+
 template<class Func>
 inline SEXP getSafeExecCall(Func const& f) {
   auto func = [] (void* x) {
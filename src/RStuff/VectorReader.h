@@ -0,0 +1,80 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RWRAPPER_R_STUFF_VECTOR_READER_H
+#define RWRAPPER_R_STUFF_VECTOR_READER_H
+
+#include "RInclude.h"
+#include <vector>
+
+// Reads elements of a logical, integer or double vector without expanding an ALTREP one
+// (INTEGER() and friends materialize the whole vector, e.g. a compact 1:n or a lazily loaded column).
+// Vectors with a data pointer are read through it, others element by element or region by region.
+// Note: `x` must be kept alive by the caller
+template <typename T>
+class VectorReader {
+public:
+  explicit VectorReader(SEXP x) : x(x), data(static_cast<const T*>(DATAPTR_OR_NULL(x))) {}
+
+  T operator [] (R_xlen_t i) const {
+    return data ? data[i] : elt(i);
+  }
+
+  // Elements [start, start + count), valid until the next call
+  const T* region(R_xlen_t start, R_xlen_t count) {
+    if (data) return data + start;
+    buffer.resize(count);
+    getRegion(start, count, buffer.data());
+    return buffer.data();
+  }
+
+private:
+  T elt(R_xlen_t i) const;
+  void getRegion(R_xlen_t start, R_xlen_t count, T* out) const;
+
+  SEXP x;
+  const T* data;
+  std::vector<T> buffer;
+};
+
+template <>
+inline int VectorReader<int>::elt(R_xlen_t i) const {
+  return TYPEOF(x) == LGLSXP ? LOGICAL_ELT(x, i) : INTEGER_ELT(x, i);
+}
+
+template <>
+inline void VectorReader<int>::getRegion(R_xlen_t start, R_xlen_t count, int* out) const {
+  if (TYPEOF(x) == LGLSXP) {
+    LOGICAL_GET_REGION(x, start, count, out);
+  } else {
+    INTEGER_GET_REGION(x, start, count, out);
+  }
+}
+
+template <>
+inline double VectorReader<double>::elt(R_xlen_t i) const {
+  return REAL_ELT(x, i);
+}
+
+template <>
+inline void VectorReader<double>::getRegion(R_xlen_t start, R_xlen_t count, double* out) const {
+  REAL_GET_REGION(x, start, count, out);
+}
+
+using IntVectorReader = VectorReader<int>;
+using DoubleVectorReader = VectorReader<double>;
+
+#endif //RWRAPPER_R_STUFF_VECTOR_READER_H
@@ -144,7 +144,7 @@ void RPIServiceImpl::subprocessHandler(
   if (askInput) {
     AsyncEvent event;
     event.mutable_subprocessinput();
-    asyncEvents.push(event);
+    sendAsyncEvent(event);
   }
   ScopedAssign<ReplState> withState(replState, askInput ? SUBPROCESS_INPUT : replState);
   while (true) {
@@ -160,7 +160,7 @@ void RPIServiceImpl::subprocessHandler(
   if (askInput) {
     AsyncEvent event;
     event.mutable_busy();
-    asyncEvents.push(event);
+    sendAsyncEvent(event);
   }
 }
 
@@ -0,0 +1,199 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "ValueInfoCache.h"
+#include "util/HyperLogLog.h"
+#include <algorithm>
+#include <cstring>
+
+ValueInfoCache valueInfoCache;
+
+// Previews show at most 20 elements, attributes such as levels or names may show more
+static const R_xlen_t FINGERPRINT_ELEMENTS = 20;
+static const R_xlen_t FINGERPRINT_ATTRIBUTE_ELEMENTS = 256;
+static const size_t FINGERPRINT_STRING_BYTES = 4096;
+static const int FINGERPRINT_MAX_NODES = 2000;
+static const size_t MAX_CACHE_SIZE = 100000;
+
+static inline void combine(uint64_t &hash, uint64_t value) {
+  hash = mixHash(hash + 0x9e3779b97f4a7c15ull + value);
+}
+
+static void combineBytes(uint64_t &hash, const void* data, size_t length) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < length; ++i) {
+    h = (h ^ ((const unsigned char*)data)[i]) * 0x100000001b3ull;
+  }
+  combine(hash, h);
+  combine(hash, length);
+}
+
+static void combineDouble(uint64_t &hash, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  combine(hash, bits);
+}
+
+static bool fingerprintObject(SEXP x, R_xlen_t elements, uint64_t &hash, int &budget);
+
+static bool fingerprintAttributes(SEXP x, uint64_t &hash, int &budget) {
+  for (SEXP a = ATTRIB(x); a != R_NilValue; a = CDR(a)) {
+    combine(hash, (uint64_t)TAG(a));
+    if (!fingerprintObject(CAR(a), FINGERPRINT_ATTRIBUTE_ELEMENTS, hash, budget)) return false;
+  }
+  return true;
+}
+
+// Symbols and environments are identified by their addresses, other objects by contents
+static bool fingerprintObject(SEXP x, R_xlen_t elements, uint64_t &hash, int &budget) {
+  if (--budget < 0) return false;
+  int type = TYPEOF(x);
+  combine(hash, type);
+  combine(hash, ((uint64_t)OBJECT(x) << 1) | (uint64_t)IS_S4_OBJECT(x));
+  switch (type) {
+    case NILSXP:
+      return true;
+    case SYMSXP:
+    case ENVSXP:
+    case SPECIALSXP:
+    case BUILTINSXP:
+      combine(hash, (uint64_t)x);
+      return true;
+    case CHARSXP:
+      if (x == NA_STRING) {
+        combine(hash, (uint64_t)x);
+      } else {
+        size_t length = (size_t)LENGTH(x);
+        combineBytes(hash, CHAR(x), std::min(length, FINGERPRINT_STRING_BYTES));
+        combine(hash, length);
+      }
+      return true;
+    case LGLSXP:
+    case INTSXP:
+    case REALSXP:
+    case CPLXSXP:
+    case STRSXP:
+    case RAWSXP:
+    case VECSXP:
+    case EXPRSXP: {
+      R_xlen_t length = Rf_xlength(x);
+      combine(hash, (uint64_t)length);
+      R_xlen_t count = std::min(length, elements);
+      for (R_xlen_t i = 0; i < count; ++i) {
+        switch (type) {
+          case LGLSXP: combine(hash, (uint64_t)LOGICAL_ELT(x, i)); break;
+          case INTSXP: combine(hash, (uint64_t)INTEGER_ELT(x, i)); break;
+          case REALSXP: combineDouble(hash, REAL_ELT(x, i)); break;
+          case CPLXSXP: {
+            Rcomplex value = COMPLEX_ELT(x, i);
+            combineDouble(hash, value.r);
+            combineDouble(hash, value.i);
+            break;
+          }
+          case RAWSXP: combine(hash, RAW_ELT(x, i)); break;
+          case STRSXP:
+            if (!fingerprintObject(STRING_ELT(x, i), elements, hash, budget)) return false;
+            break;
+          default:
+            if (!fingerprintObject(VECTOR_ELT(x, i), elements, hash, budget)) return false;
+        }
+      }
+      return fingerprintAttributes(x, hash, budget);
+    }
+    case LISTSXP:
+    case LANGSXP:
+      for (SEXP node = x; node != R_NilValue; node = CDR(node)) {
+        if (TYPEOF(node) != LISTSXP && TYPEOF(node) != LANGSXP) return false;
+        if (--budget < 0) return false;
+        combine(hash, (uint64_t)TAG(node));
+        if (!fingerprintObject(CAR(node), elements, hash, budget)) return false;
+      }
+      return fingerprintAttributes(x, hash, budget);
+    default:
+      return false;
+  }
+}
+
+bool ValueInfoCache::fingerprint(SEXP x, uint64_t &hash) {
+  int budget = FINGERPRINT_MAX_NODES;
+  hash = printOptionsHash;
+  switch (TYPEOF(x)) {
+    case LGLSXP:
+    case INTSXP:
+    case REALSXP:
+    case CPLXSXP:
+    case STRSXP:
+    case RAWSXP:
+      return fingerprintObject(x, FINGERPRINT_ELEMENTS, hash, budget);
+    case VECSXP:
+    case EXPRSXP:
+    case S4SXP:
+      // Only the length and the attributes are shown
+      combine(hash, TYPEOF(x));
+      combine(hash, ((uint64_t)OBJECT(x) << 1) | (uint64_t)IS_S4_OBJECT(x));
+      combine(hash, (uint64_t)Rf_xlength(x));
+      return fingerprintAttributes(x, hash, budget);
+    case CLOSXP:
+      // Only the header is shown
+      combine(hash, CLOSXP);
+      return fingerprintObject(FORMALS(x), FINGERPRINT_ELEMENTS, hash, budget) &&
+             fingerprintAttributes(x, hash, budget);
+    default:
+      return false;
+  }
+}
+
+bool ValueInfoCache::get(SEXP x, uint64_t hash, ValueInfo* result) {
+  auto it = entries.find(x);
+  if (it == entries.end() || it->second.hash != hash) {
+    ++misses;
+    return false;
+  }
+  ++hits;
+  it->second.lastUsed = generation;
+  result->CopyFrom(it->second.info);
+  return true;
+}
+
+void ValueInfoCache::put(SEXP x, uint64_t hash, ValueInfo const& info) {
+  if (entries.size() >= MAX_CACHE_SIZE) entries.clear();
+  Entry &entry = entries[x];
+  entry.hash = hash;
+  entry.lastUsed = generation;
+  entry.info.CopyFrom(info);
+}
+
+void ValueInfoCache::nextGeneration() {
+  ++generation;
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (it->second.lastUsed + 1 < generation) {
+      it = entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  // Printed previews depend on these options
+  uint64_t optionsHash = 0;
+  int budget = FINGERPRINT_MAX_NODES;
+  for (const char* name : {"digits", "scipen", "OutDec", "width"}) {
+    fingerprintObject(Rf_GetOption1(Rf_install(name)), FINGERPRINT_ELEMENTS, optionsHash, budget);
+  }
+  if (optionsHash != printOptionsHash) {
+    printOptionsHash = optionsHash;
+    entries.clear();
+  }
+}
@@ -0,0 +1,60 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_VALUE_INFO_CACHE_H
+#define RWRAPPER_VALUE_INFO_CACHE_H
+
+#include "RPIServiceImpl.h"
+#include "RStuff/RInclude.h"
+#include <cstdint>
+#include <unordered_map>
+
+// Caches ValueInfo of objects between refreshes of the variables view.
+// An entry is keyed by the object and checked against a fingerprint of everything its ValueInfo depends on
+// (type, length, attributes, the previewed elements, formals of functions), so modified or reallocated objects miss.
+// The cache holds no references: entries that were not used during the last generation
+// (a generation ends when a command is executed in the console) are evicted.
+// Must be used only on the main thread.
+class ValueInfoCache {
+public:
+  // Returns false if the object is not cacheable
+  bool fingerprint(SEXP x, uint64_t &hash);
+  bool get(SEXP x, uint64_t hash, ValueInfo* result);
+  void put(SEXP x, uint64_t hash, ValueInfo const& info);
+  void nextGeneration();
+
+  long long getHits() const { return hits; }
+  long long getMisses() const { return misses; }
+  size_t size() const { return entries.size(); }
+
+private:
+  struct Entry {
+    uint64_t hash;
+    uint64_t lastUsed;
+    ValueInfo info;
+  };
+
+  std::unordered_map<SEXP, Entry> entries;
+  uint64_t generation = 0;
+  uint64_t printOptionsHash = 0;
+  long long hits = 0;
+  long long misses = 0;
+};
+
+extern ValueInfoCache valueInfoCache;
+
+#endif //RWRAPPER_VALUE_INFO_CACHE_H
@@ -59,7 +59,7 @@ Status RPIServiceImpl::debugCommandContinue(ServerContext*, const Empty*, Empty*
       rDebugger.setCommand(CONTINUE);
       breakEventLoop("");
     }
-  });
+  }, false, TaskPriority::INTERACTIVE);
   return Status::OK;
 }
 
@@ -79,7 +79,7 @@ Status RPIServiceImpl::debugCommandStop(ServerContext*, const Empty*, Empty*) {
         rDebugger.setCommand(ABORT);
         breakEventLoop("");
       }
-    });
+    }, false, TaskPriority::INTERACTIVE);
   }
   return Status::OK;
 }
@@ -90,7 +90,7 @@ Status RPIServiceImpl::debugCommandStepOver(ServerContext*, const Empty*, Empty*
       rDebugger.setCommand(STEP_OVER);
       breakEventLoop("");
     }
-  });
+  }, false, TaskPriority::INTERACTIVE);
   return Status::OK;
 }
 
@@ -100,7 +100,7 @@ Status RPIServiceImpl::debugCommandStepInto(ServerContext*, const Empty*, Empty*
       rDebugger.setCommand(STEP_INTO);
       breakEventLoop("");
     }
-  });
+  }, false, TaskPriority::INTERACTIVE);
   return Status::OK;
 }
 
@@ -110,7 +110,7 @@ Status RPIServiceImpl::debugCommandStepIntoMyCode(ServerContext*, const Empty*,
       rDebugger.setCommand(STEP_INTO_MY_CODE);
       breakEventLoop("");
     }
-  });
+  }, false, TaskPriority::INTERACTIVE);
   return Status::OK;
 }
 
@@ -120,7 +120,7 @@ Status RPIServiceImpl::debugCommandStepOut(ServerContext*, const Empty*, Empty*)
       rDebugger.setCommand(STEP_OUT);
       breakEventLoop("");
     }
-  });
+  }, false, TaskPriority::INTERACTIVE);
   return Status::OK;
 }
 
@@ -132,7 +132,7 @@ Status RPIServiceImpl::debugCommandRunToPosition(ServerContext*, const SourcePos
       rDebugger.setRunToPositionCommand(fileId, line);
       breakEventLoop("");
     }
-  });
+  }, false, TaskPriority::INTERACTIVE);
   return Status::OK;
 }
 
@@ -47,6 +47,7 @@ void DeviceManager::initNew(const std::string& snapshotDirectory, ScreenParamete
   }
   auto newDevice = makePtr<MasterDevice>(snapshotDirectory, screenParameters, deviceStack.size(), inMemory, isProxy);
   deviceStack.push(newDevice);
+  MasterDevice::clearPublishedPlots();
 }
 
 void DeviceManager::initNew(const std::string &snapshotDirectory, ScreenParameters screenParameters, bool inMemory) {
@@ -66,6 +67,7 @@ void DeviceManager::shutdownLast() {
   if (!deviceStack.empty()) {
     auto lastDevice = deviceStack.top();
     deviceStack.pop();
+    MasterDevice::clearPublishedPlots();
   } else {
     std::cerr << "DeviceManager::shutdownLast(): nothing to shutdown. Ignored\n";
   }
@@ -15,6 +15,7 @@
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 
+#include <cstdio>
 #include <cstring>
 #include <sstream>
 #include <fstream>
@@ -28,6 +29,7 @@
 #include "DeviceManager.h"
 #include "PlotUtil.h"
 #include "RVersionHelper.h"
+#include "../EventLoop.h"
 #include "../RInternals/RInternals.h"
 
 namespace graphics {
@@ -40,6 +42,8 @@ const auto FIRST_PROXY_SIZE = Size{2570, 1920};
 
 const auto MAX_COMPLEXITY = 500000;  // 500k
 
+const auto RENDERED_SNAPSHOTS_BUDGET = 64LL << 20;  // 64 MB of rescaled PNGs per snapshot directory
+
 MasterDevice* masterOf(pDevDesc descriptor) {
   auto masterDevice = MasterDevice::from(descriptor);
   if (!masterDevice) {
@@ -276,6 +280,13 @@ Ptr<REagerGraphicsDevice> MasterDevice::getDeviceAt(int number) {
 void MasterDevice::clearAllDevices() {
   auto command = SnapshotUtil::makeRemoveVariablesCommand(deviceNumber, 0, currentDeviceInfos.size());
   Evaluator::evaluate(command);
+  for (auto& pending : pendingRescales) {
+    eventLoopCancel(pending.second, false);
+  }
+  pendingRescales.clear();
+  if (isActive()) clearPublishedPlots();
+  renderedSnapshots.clear();
+  renderedSnapshotsBytes = 0;
   currentDeviceInfos.clear();
   currentSnapshotNumber = -1;
   addNewDevice();  // Note: prevent potential out of range errors
@@ -360,8 +371,15 @@ std::vector<int> MasterDevice::commitAllLast(bool withRescale, ScreenParameters
     if (currentDeviceInfos[number].hasDumped) {
       break;
     }
-    if (commitByNumber(number, withRescale, newParameters)) {
+    // Note: only the latest plot is visible right after the command, so the older ones are just dumped
+    // with their current parameters and re-rendered when R is idle.
+    // Their files stay valid in the meantime and a rescaled version will replace them later
+    auto isDeferred = withRescale && !committedNumbers.empty();
+    if (commitByNumber(number, withRescale && !isDeferred, newParameters)) {
       committedNumbers.push_back(number);
+      if (isDeferred) {
+        scheduleRescale(number, newParameters);
+      }
     }
   }
   if (!committedNumbers.empty()) {
@@ -398,7 +416,8 @@ bool MasterDevice::commitByNumber(int number, bool withRescale, ScreenParameters
   if (!device->isBlank()) {
     recordAndDumpIfNecessary(deviceInfo, number);
     if (withRescale) {
-      rescaleAndDumpIfNecessary(deviceInfo, newParameters);
+      cancelPendingRescale(number);  // Note: it would overwrite this snapshot with obsolete parameters otherwise
+      rescaleAndDumpIfNecessary(deviceInfo, number, newParameters);
     }
     return true;
   } else {
@@ -406,6 +425,42 @@ bool MasterDevice::commitByNumber(int number, bool withRescale, ScreenParameters
   }
 }
 
+void MasterDevice::scheduleRescale(int number, ScreenParameters newParameters) {
+  cancelPendingRescale(number);
+  auto device = currentDeviceInfos[number].device;
+  auto weakDevice = std::weak_ptr<REagerGraphicsDevice>(device);
+  auto options = TaskOptions(TaskPriority::BACKGROUND);
+  options.supersedeKey = "graphicsRescale:" + std::to_string(deviceNumber) + ":" + std::to_string(number);
+  pendingRescales[number] = eventLoopExecute([weakDevice, number, newParameters] {
+    // Note: the master device might have been shut down or replaced by the time R is idle
+    auto device = weakDevice.lock();
+    auto active = DeviceManager::getInstance()->getActive();
+    if (device && active) {
+      active->runPendingRescale(number, device, newParameters);
+    }
+  }, false, options);
+}
+
+void MasterDevice::cancelPendingRescale(int number) {
+  auto it = pendingRescales.find(number);
+  if (it != pendingRescales.end()) {
+    eventLoopCancel(it->second, false);
+    pendingRescales.erase(it);
+  }
+}
+
+void MasterDevice::runPendingRescale(int number, const Ptr<REagerGraphicsDevice>& device, ScreenParameters newParameters) {
+  if (number >= int(currentDeviceInfos.size()) || currentDeviceInfos[number].device != device) {
+    return;
+  }
+  pendingRescales.erase(number);
+  try {
+    rescaleAndDumpIfNecessary(currentDeviceInfos[number], number, newParameters);
+  } catch (const std::exception& e) {
+    std::cerr << "Failed to rescale snapshot #" << number << ": " << e.what() << "\n";
+  }
+}
+
 bool MasterDevice::rescaleByPath(const std::string& parentDirectory, int number, int version, ScreenParameters newParameters) {
   if (!masterDeviceDescriptor) {
     return false;
@@ -434,12 +489,20 @@ std::vector<int> MasterDevice::dumpAllLast() {
   return commitAllLast(false, ScreenParameters{});
 }
 
-Plot MasterDevice::fetchPlot(int number) {
+Ptr<Plot> MasterDevice::fetchPlot(int number) {
   // Make sure this plot is not too complex
   // (otherwise it won't be possible to pass it via gRPC)
   auto totalComplexity = getDeviceAt(number)->estimatedComplexity();
   if (totalComplexity > MAX_COMPLEXITY) {
-    return PlotUtil::createPlotWithError(PlotError::TOO_COMPLEX);
+    return makePtr<Plot>(PlotUtil::createPlotWithError(PlotError::TOO_COMPLEX));
+  }
+
+  // Both proxy replays are expensive (seconds for complex ggplots), so the result is reused
+  // until the plot is recorded again
+  auto& deviceInfo = currentDeviceInfos[number];
+  if (deviceInfo.fetchedPlot) {
+    publishPlot(number, deviceInfo.fetchedPlot);
+    return deviceInfo.fetchedPlot;
   }
 
   // Replay plot on the proxy device in order to extrapolate
@@ -449,7 +512,40 @@ Plot MasterDevice::fetchPlot(int number) {
                                     secondDevice->logicSizeInInches(), secondDevice->recordedActions(),
                                     totalComplexity);
   DeviceManager::getInstance()->getProxy()->clearAllDevices();
-  return plot;
+  deviceInfo.fetchedPlot = makePtr<Plot>(std::move(plot));
+  publishPlot(number, deviceInfo.fetchedPlot);
+  return deviceInfo.fetchedPlot;
+}
+
+std::mutex MasterDevice::publishedPlotsMutex;
+std::unordered_map<int, Ptr<Plot>> MasterDevice::publishedPlots;
+
+bool MasterDevice::isActive() {
+  return DeviceManager::getInstance()->getActive().get() == this;
+}
+
+// Note: plots are immutable once fetched, so sharing them with other threads is safe
+void MasterDevice::publishPlot(int number, const Ptr<Plot>& plot) {
+  if (!isActive()) return;
+  std::unique_lock<std::mutex> lock(publishedPlotsMutex);
+  publishedPlots[number] = plot;
+}
+
+void MasterDevice::unpublishPlot(int number) {
+  if (!isActive()) return;
+  std::unique_lock<std::mutex> lock(publishedPlotsMutex);
+  publishedPlots.erase(number);
+}
+
+Ptr<Plot> MasterDevice::getPublishedPlot(int number) {
+  std::unique_lock<std::mutex> lock(publishedPlotsMutex);
+  auto it = publishedPlots.find(number);
+  return it != publishedPlots.end() ? it->second : nullptr;
+}
+
+void MasterDevice::clearPublishedPlots() {
+  std::unique_lock<std::mutex> lock(publishedPlotsMutex);
+  publishedPlots.clear();
 }
 
 Ptr<REagerGraphicsDevice> MasterDevice::replayOnProxy(int number, Size size) {
@@ -663,17 +759,98 @@ void MasterDevice::recordAndDumpIfNecessary(DeviceInfo &deviceInfo, int number)
   }
   if (!deviceInfo.hasDumped) {
     dumpNormal(deviceInfo);
+    addRendered(number, deviceInfo.device);
   }
 }
 
-void MasterDevice::rescaleAndDumpIfNecessary(DeviceInfo& deviceInfo, ScreenParameters newParameters) {
+void MasterDevice::rescaleAndDumpIfNecessary(DeviceInfo& deviceInfo, int number, ScreenParameters newParameters) {
   auto previousParameters = deviceInfo.device->logicScreenParameters();
   if (!deviceInfo.hasRescaled || !isClose(previousParameters, newParameters)) {
-    rescaleAndDump(deviceInfo.device, SnapshotType::NORMAL, newParameters);
+    // Note: toggling between a couple of pane sizes is common so the previously dumped versions are reused
+    if (!restoreRendered(deviceInfo, number, newParameters)) {
+      rescaleAndDump(deviceInfo.device, SnapshotType::NORMAL, newParameters);
+      addRendered(number, deviceInfo.device);
+    }
     deviceInfo.hasRescaled = true;
   }
 }
 
+std::string MasterDevice::makeRenderedPath(int number, int version, int resolution) {
+  return currentSnapshotDirectory + "/" + SnapshotUtil::makeSnapshotName(number, version, resolution);
+}
+
+bool MasterDevice::restoreRendered(DeviceInfo& deviceInfo, int number, ScreenParameters newParameters) {
+  for (auto it = renderedSnapshots.begin(); it != renderedSnapshots.end(); ++it) {
+    if (it->number != number || !isClose(it->parameters, newParameters)) {
+      continue;
+    }
+    auto& device = deviceInfo.device;
+    if (it->version == device->currentVersion()) {
+      return true;  // Note: already shown
+    }
+    // Note: the cached file is moved to a new version so the client picks it up.
+    // The old version is lower than the current one, hence no longer referenced by the client
+    auto oldPath = makeRenderedPath(number, it->version, it->parameters.resolution);
+    auto version = device->restoreVersion(it->parameters);
+    if (std::rename(oldPath.c_str(), makeRenderedPath(number, version, it->parameters.resolution).c_str()) != 0) {
+      // Note: the file might have been removed by someone else
+      std::remove(oldPath.c_str());
+      renderedSnapshotsBytes -= it->bytes;
+      renderedSnapshots.erase(it);
+      return false;
+    }
+    it->version = version;
+    renderedSnapshots.splice(renderedSnapshots.begin(), renderedSnapshots, it);
+    return true;
+  }
+  return false;
+}
+
+void MasterDevice::addRendered(int number, const Ptr<REagerGraphicsDevice>& device) {
+  auto version = device->currentVersion();
+  auto parameters = device->logicScreenParameters();
+  auto file = std::ifstream(makeRenderedPath(number, version, parameters.resolution), std::ios::binary | std::ios::ate);
+  if (!file) {
+    return;
+  }
+  auto bytes = static_cast<long long>(file.tellg());
+  renderedSnapshots.push_front(RenderedSnapshot{number, version, parameters, bytes});
+  renderedSnapshotsBytes += bytes;
+
+  // Evict the least recently used versions.
+  // Note: the currently shown version is the highest one and hence the only one the client might still reference,
+  // so its file is kept on disk and only dropped from the cache
+  auto it = renderedSnapshots.end();
+  while (renderedSnapshotsBytes > RENDERED_SNAPSHOTS_BUDGET && it != renderedSnapshots.begin()) {
+    --it;
+    if (!isShownVersion(it->number, it->version)) {
+      std::remove(makeRenderedPath(it->number, it->version, it->parameters.resolution).c_str());
+    }
+    renderedSnapshotsBytes -= it->bytes;
+    it = renderedSnapshots.erase(it);
+  }
+}
+
+bool MasterDevice::isShownVersion(int number, int version) {
+  // Note: an unknown snapshot is treated as shown to stay on the safe side
+  auto shown = getDeviceAt(number);
+  return !shown || shown->currentVersion() <= version;
+}
+
+void MasterDevice::forgetRendered(int number) {
+  for (auto it = renderedSnapshots.begin(); it != renderedSnapshots.end();) {
+    if (it->number != number) {
+      ++it;
+      continue;
+    }
+    if (!isShownVersion(number, it->version)) {
+      std::remove(makeRenderedPath(it->number, it->version, it->parameters.resolution).c_str());
+    }
+    renderedSnapshotsBytes -= it->bytes;
+    it = renderedSnapshots.erase(it);
+  }
+}
+
 void MasterDevice::rescaleAndDump(const Ptr<REagerGraphicsDevice>& device, SnapshotType type, ScreenParameters newParameters) {
   device->rescale(type, newParameters);
   device->replay();
@@ -708,6 +885,9 @@ void MasterDevice::record(DeviceInfo& deviceInfo, int number) {
   auto saveCommand = SnapshotUtil::makeSaveVariableCommand(currentSnapshotDirectory, deviceNumber, number);
   Evaluator::evaluate(saveCommand);
   deviceInfo.hasRecorded = true;
+  deviceInfo.fetchedPlot = nullptr;
+  unpublishPlot(number);
+  forgetRendered(number);  // Note: the dumped versions might be outdated now
 }
 
 MasterDevice::~MasterDevice() {
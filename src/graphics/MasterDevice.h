@@ -18,7 +18,10 @@
 #ifndef MASTER_DEVICE_H
 #define MASTER_DEVICE_H
 
+#include <list>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include "Ptr.h"
 #include "Plot.h"
@@ -36,6 +39,15 @@ class MasterDevice {
     bool hasDumped = false;
     bool hasGgPlot = false;
     bool hasRescaled = false;
+    Ptr<Plot> fetchedPlot;  // Doesn't depend on screen parameters, reset when the plot is recorded again
+  };
+
+  // A snapshot that has been dumped with the given parameters and whose file is kept for the later rescales
+  struct RenderedSnapshot {
+    int number;
+    int version;
+    ScreenParameters parameters;
+    long long bytes;
   };
 
   InitHelper initHelper;  // Rollback to previous active GD when this is closed (used in device dtor)
@@ -43,6 +55,9 @@ class MasterDevice {
   std::string currentSnapshotDirectory;
   ScreenParameters currentScreenParameters;
   std::vector<DeviceInfo> currentDeviceInfos;
+  std::unordered_map<int, uint64_t> pendingRescales;  // Snapshot number -> ID of the deferred rescale task
+  std::list<RenderedSnapshot> renderedSnapshots;  // Most recently used first
+  long long renderedSnapshotsBytes = 0;
   int currentSnapshotNumber;
   bool isNextGgPlot;
   int deviceNumber;
@@ -53,12 +68,27 @@ class MasterDevice {
 
   void record(DeviceInfo& deviceInfo, int number);
   static void rescaleAndDump(const Ptr<REagerGraphicsDevice>& device, SnapshotType type, ScreenParameters newParameters);
-  static void rescaleAndDumpIfNecessary(DeviceInfo& deviceInfo, ScreenParameters newParameters);
+  void rescaleAndDumpIfNecessary(DeviceInfo& deviceInfo, int number, ScreenParameters newParameters);
+  std::string makeRenderedPath(int number, int version, int resolution);
+  bool restoreRendered(DeviceInfo& deviceInfo, int number, ScreenParameters newParameters);
+  void addRendered(int number, const Ptr<REagerGraphicsDevice>& device);
+  void forgetRendered(int number);
+  bool isShownVersion(int number, int version);
   static void dumpNormal(DeviceInfo &deviceInfo);
   void recordAndDumpIfNecessary(DeviceInfo &deviceInfo, int number);
   std::vector<int> commitAllLast(bool withRescale, ScreenParameters newParameters);
   bool commitByNumber(int number, bool withRescale, ScreenParameters newParameters);
+  void scheduleRescale(int number, ScreenParameters newParameters);
+  void cancelPendingRescale(int number);
+  void runPendingRescale(int number, const Ptr<REagerGraphicsDevice>& device, ScreenParameters newParameters);
   Ptr<REagerGraphicsDevice> replayOnProxy(int number, Size size);
+  bool isActive();
+  void publishPlot(int number, const Ptr<Plot>& plot);
+  void unpublishPlot(int number);
+
+  // Fetched plots of the active device by snapshot number, guarded by the mutex
+  static std::mutex publishedPlotsMutex;
+  static std::unordered_map<int, Ptr<Plot>> publishedPlots;
 
 public:
   MasterDevice(std::string snapshotDirectory, ScreenParameters screenParameters, int deviceNumber, bool inMemory, bool isProxy);
@@ -79,7 +109,11 @@ public:
   bool rescaleByNumber(int number, ScreenParameters newParameters);
   bool rescaleByPath(const std::string& parentDirectory, int number, int version, ScreenParameters newParameters);
   std::vector<int> dumpAllLast();
-  Plot fetchPlot(int number);
+  Ptr<Plot> fetchPlot(int number);
+  // Can be called from any thread: returns the plot of the active device if it has been fetched already, null otherwise
+  static Ptr<Plot> getPublishedPlot(int number);
+  // Must be called when the active device changes
+  static void clearPublishedPlots();
   void onNewPage();
   void finalize();
   void shutdown();
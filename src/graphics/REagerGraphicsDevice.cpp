@@ -96,7 +96,7 @@ REagerGraphicsDevice::REagerGraphicsDevice(std::string snapshotDirectory, int de
                                            int snapshotVersion, ScreenParameters parameters, bool inMemory, bool isProxy,
                                            Ptr<DeviceSlotLock> deviceSlotLock)
     : snapshotDirectory(std::move(snapshotDirectory)), deviceNumber(deviceNumber), snapshotNumber(snapshotNumber),
-      snapshotVersion(snapshotVersion), parameters(parameters), slaveDevice(nullptr), isDeviceBlank(true),
+      snapshotVersion(snapshotVersion), lastVersion(snapshotVersion), parameters(parameters), slaveDevice(nullptr), isDeviceBlank(true),
       snapshotType(SnapshotType::NORMAL), hasDumped(false), isProxy(isProxy), isPlotOnNewPage(false),
       clippingArea({-1.0, -1.0, -1.0, -1.0}), inMemory(inMemory),
       deviceSlotLock(std::move(deviceSlotLock))
@@ -414,10 +414,22 @@ void REagerGraphicsDevice::rescale(SnapshotType newType, ScreenParameters newPar
   shutdownSlaveDevice();
   snapshotType = newType;
   parameters = newParameters;
-  snapshotVersion++;
+  snapshotVersion = ++lastVersion;
   hasDumped = false;
 }
 
+// Switches to the parameters of a previously dumped version whose file is to be moved to the returned version.
+// Note: the version is never rolled back since the client always shows the highest one
+int REagerGraphicsDevice::restoreVersion(ScreenParameters oldParameters) {
+  DEVICE_TRACE;
+  shutdownSlaveDevice();
+  snapshotType = SnapshotType::NORMAL;
+  parameters = oldParameters;
+  snapshotVersion = ++lastVersion;
+  hasDumped = true;
+  return snapshotVersion;
+}
+
 const std::vector<Ptr<Action>>& REagerGraphicsDevice::recordedActions() {
   return actions;
 }
@@ -53,6 +53,7 @@ private:
   int deviceNumber;
   int snapshotNumber;
   int snapshotVersion;
+  int lastVersion;  // Versions are never reused since their files might be kept for the later rescales
   std::string snapshotPath;
   SnapshotType snapshotType;
   std::string snapshotDirectory;
@@ -114,6 +115,7 @@ public:
   void drawTextUtf8(const char* text, Point at, double rotation, double heightAdjustment, pGEcontext context);
   bool dump();
   void rescale(SnapshotType newType, ScreenParameters newParameters);
+  int restoreVersion(ScreenParameters oldParameters);
   const std::vector<Ptr<Action>>& recordedActions();
   bool isOnNewPage();
   bool isBlank();
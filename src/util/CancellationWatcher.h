@@ -0,0 +1,88 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_CANCELLATION_WATCHER_H
+#define RWRAPPER_CANCELLATION_WATCHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Polls registered checks on a single thread, so that threads waiting for a result
+// don't have to wake up periodically to find out whether they were cancelled
+class CancellationWatcher {
+public:
+  explicit CancellationWatcher(std::chrono::milliseconds period) : period(period) {
+  }
+
+  ~CancellationWatcher() {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      stopped = true;
+      condVar.notify_all();
+    }
+    if (thread.joinable()) thread.join();
+  }
+
+  // `check` is called on the watcher thread until it returns true or is removed
+  int add(std::function<bool()> check) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!thread.joinable()) thread = std::thread([this] { run(); });
+    int id = nextId++;
+    checks.emplace(id, std::move(check));
+    condVar.notify_all();
+    return id;
+  }
+
+  // After this returns the check is not running and won't be called again
+  void remove(int id) {
+    std::unique_lock<std::mutex> lock(mutex);
+    checks.erase(id);
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopped) {
+      if (checks.empty()) {
+        condVar.wait(lock, [&] { return stopped || !checks.empty(); });
+        continue;
+      }
+      if (condVar.wait_for(lock, period, [&] { return stopped; })) break;
+      for (auto it = checks.begin(); it != checks.end();) {
+        if (it->second()) {
+          it = checks.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+  }
+
+  std::chrono::milliseconds period;
+  std::unordered_map<int, std::function<bool()>> checks;
+  int nextId = 0;
+  bool stopped = false;
+  std::mutex mutex;
+  std::condition_variable condVar;
+  std::thread thread;
+};
+
+#endif //RWRAPPER_CANCELLATION_WATCHER_H
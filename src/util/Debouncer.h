@@ -0,0 +1,77 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_DEBOUNCER_H
+#define RWRAPPER_DEBOUNCER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Keeps only the latest of the requests with the same key:
+// a request that is followed by a newer one within the delay, or before it starts, becomes obsolete.
+// Each `submit` must be paired with `finish`
+class Debouncer {
+public:
+  // Registers a new request for `key`, making the previous ones obsolete, and returns its ticket.
+  // `isBurst` tells whether another request for the key is still in flight
+  uint64_t submit(std::string const& key, bool &isBurst) {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t ticket = ++lastTicket;
+    Requests &requests = requestsByKey[key];
+    isBurst = requests.inFlight > 0;
+    requests.latest = ticket;
+    ++requests.inFlight;
+    condVar.notify_all();
+    return ticket;
+  }
+
+  // Waits until `delay` passes without newer requests for the key, returns false if the request became obsolete
+  bool wait(std::string const& key, uint64_t ticket, std::chrono::milliseconds delay) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return !condVar.wait_for(lock, delay, [&] { return requestsByKey[key].latest != ticket; });
+  }
+
+  bool isLatest(std::string const& key, uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = requestsByKey.find(key);
+    return it != requestsByKey.end() && it->second.latest == ticket;
+  }
+
+  // Forgets the key when no requests for it are left
+  void finish(std::string const& key) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = requestsByKey.find(key);
+    if (it != requestsByKey.end() && --it->second.inFlight == 0) requestsByKey.erase(it);
+  }
+
+private:
+  struct Requests {
+    uint64_t latest = 0;
+    int inFlight = 0;
+  };
+
+  std::mutex mutex;
+  std::condition_variable condVar;
+  std::unordered_map<std::string, Requests> requestsByKey;
+  uint64_t lastTicket = 0;
+};
+
+#endif //RWRAPPER_DEBOUNCER_H
@@ -0,0 +1,71 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_HYPER_LOG_LOG_H
+#define RWRAPPER_HYPER_LOG_LOG_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Approximate count of distinct values, the standard error is about 1.6%
+class HyperLogLog {
+  static const int PRECISION = 12;
+  static const int REGISTERS = 1 << PRECISION;
+  std::vector<uint8_t> registers;
+
+public:
+  HyperLogLog() : registers(REGISTERS) {}
+
+  // `hash` should be well mixed, see mixHash()
+  void add(uint64_t hash) {
+    size_t index = hash >> (64 - PRECISION);
+    uint64_t rest = (hash << PRECISION) | ((uint64_t)1 << (PRECISION - 1));
+    uint8_t rank = 1;
+    while (!(rest & 0x8000000000000000ull)) {
+      rest <<= 1;
+      ++rank;
+    }
+    if (rank > registers[index]) registers[index] = rank;
+  }
+
+  double estimate() const {
+    double sum = 0;
+    int zeros = 0;
+    for (uint8_t r : registers) {
+      sum += std::ldexp(1.0, -r);
+      if (r == 0) ++zeros;
+    }
+    double m = REGISTERS;
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+      estimate = m * std::log(m / zeros);
+    }
+    return estimate;
+  }
+};
+
+inline uint64_t mixHash(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+#endif //RWRAPPER_HYPER_LOG_LOG_H
@@ -0,0 +1,49 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_LATENCY_HISTOGRAM_H
+#define RWRAPPER_LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+
+// Thread-safe histogram of durations. Bucket i counts durations below 2^i microseconds
+// that did not fit into the previous bucket, the last bucket has no upper bound
+class LatencyHistogram {
+public:
+  static const int BUCKETS = 32;
+
+  LatencyHistogram() {
+    for (auto &count : counts) count.store(0);
+  }
+
+  void add(std::chrono::steady_clock::duration duration) {
+    long long micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && (1LL << bucket) <= micros) ++bucket;
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  long long count(int bucket) const {
+    return counts[bucket].load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<long long> counts[BUCKETS];
+};
+
+#endif //RWRAPPER_LATENCY_HISTOGRAM_H
@@ -0,0 +1,161 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_MPSC_QUEUE_H
+#define RWRAPPER_MPSC_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Lock-free multi-producer single-consumer queue (ring buffer with per-cell sequence numbers).
+// Locks are taken only when the ring is full or when the consumer is asleep.
+// Values that don't fit are kept in an overflow list, each one is merged into the last element there if possible,
+// so push never blocks and nothing is lost.
+// Values pushed by one thread are always consumed in the order they were pushed.
+template <typename T>
+class MPSCQueue {
+public:
+  // Merges `value` into `last` and returns true if they can be merged
+  typedef std::function<bool(T& last, T const& value)> Merger;
+
+  explicit MPSCQueue(size_t capacity, Merger merger = nullptr) : merger(std::move(merger)) {
+    size_t size = 2;
+    while (size < capacity) size *= 2;
+    mask = size - 1;
+    cells.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  void push(T const& value) {
+    if (!hasOverflow.load() && tryPush(value)) {
+      wakeConsumer();
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    // Once the overflow list is non-empty, new values go there too, so that the order is preserved
+    if (!hasOverflow.load() && tryPush(value)) {
+      lock.unlock();
+      wakeConsumer();
+      return;
+    }
+    if (overflow.empty() || !merger || !merger(overflow.back(), value)) {
+      overflow.push_back(value);
+    }
+    hasOverflow.store(true);
+    if (consumerSleeping.load()) condVar.notify_all();
+  }
+
+  // Must be called only by the consumer thread
+  bool poll(T &value) {
+    return tryPop(value) || popOverflow(value);
+  }
+
+  // Must be called only by the consumer thread
+  template<class TimePoint>
+  bool popWithDeadline(TimePoint const& deadline, T &value) {
+    if (poll(value)) return true;
+    std::unique_lock<std::mutex> lock(mutex);
+    consumerSleeping.store(true);
+    bool result = false;
+    condVar.wait_until(lock, deadline, [&] {
+      result = tryPop(value) || popOverflowLocked(value);
+      return result;
+    });
+    consumerSleeping.store(false);
+    return result;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  bool tryPush(T const& value) {
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells[position & mask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+      if (diff == 0) {
+        if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = enqueuePosition.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = value;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T &value) {
+    Cell* cell = &cells[dequeuePosition & mask];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    if ((intptr_t)sequence - (intptr_t)(dequeuePosition + 1) < 0) return false;
+    value = std::move(cell->value);
+    cell->value = T();
+    cell->sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+    ++dequeuePosition;
+    return true;
+  }
+
+  // The overflow list is consumed only after the ring is empty, values in the ring are older
+  bool popOverflow(T &value) {
+    if (!hasOverflow.load()) return false;
+    std::unique_lock<std::mutex> lock(mutex);
+    return popOverflowLocked(value);
+  }
+
+  bool popOverflowLocked(T &value) {
+    if (overflow.empty()) return false;
+    value = std::move(overflow.front());
+    overflow.pop_front();
+    if (overflow.empty()) hasOverflow.store(false);
+    return true;
+  }
+
+  // The fence orders the preceding ring update before the flag check, the consumer sets the flag with a seq_cst store
+  void wakeConsumer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!consumerSleeping.load()) return;
+    std::unique_lock<std::mutex> lock(mutex);
+    condVar.notify_all();
+  }
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask;
+  std::atomic<size_t> enqueuePosition{0};
+  size_t dequeuePosition = 0;
+
+  Merger merger;
+
+  std::mutex mutex;
+  std::condition_variable condVar;
+  std::deque<T> overflow;
+  std::atomic<bool> hasOverflow{false};
+  std::atomic<bool> consumerSleeping{false};
+};
+
+#endif //RWRAPPER_MPSC_QUEUE_H
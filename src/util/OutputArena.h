@@ -0,0 +1,156 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_OUTPUT_ARENA_H
+#define RWRAPPER_OUTPUT_ARENA_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Buffers console output as runs of bytes of the same stream type.
+// Producers append to a preallocated buffer, the consumer takes the whole buffer by swapping it with its own one,
+// so no memory is allocated in the steady state.
+// Positions count bytes since the start, they are used to order output relative to other events.
+class OutputArena {
+public:
+  enum class OverflowPolicy { GROW, BLOCK, DROP };
+
+  // `onThreshold` is called (without locks held) when the buffered size reaches `flushThreshold`
+  OutputArena(size_t capacity, size_t flushThreshold, std::function<void()> onThreshold)
+    : capacity(capacity), flushThreshold(flushThreshold), onThreshold(std::move(onThreshold)) {
+    buffer.reserve(capacity);
+    taken.reserve(capacity);
+  }
+
+  void setOverflowPolicy(OverflowPolicy newPolicy) {
+    std::unique_lock<std::mutex> lock(mutex);
+    policy = newPolicy;
+    condVar.notify_all();
+  }
+
+  void append(const char* data, size_t length, int type) {
+    if (length == 0) return;
+    bool reachedThreshold;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (buffer.size() + length > capacity && !buffer.empty()) {
+        if (policy == OverflowPolicy::DROP) {
+          droppedBytes += length;
+          return;
+        }
+        if (policy == OverflowPolicy::BLOCK) {
+          if (onThreshold) {
+            lock.unlock();
+            onThreshold();
+            lock.lock();
+          }
+          condVar.wait(lock, [&] { return policy != OverflowPolicy::BLOCK || buffer.size() + length <= capacity || buffer.empty(); });
+        }
+      }
+      bool wasBelowThreshold = buffer.size() < flushThreshold;
+      buffer.append(data, length);
+      endPosition += length;
+      if (!runs.empty() && runs.back().type == type) {
+        runs.back().end = endPosition;
+      } else {
+        runs.push_back({type, endPosition});
+      }
+      reachedThreshold = wasBelowThreshold && buffer.size() >= flushThreshold;
+    }
+    if (reachedThreshold && onThreshold) onThreshold();
+  }
+
+  uint64_t position() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return endPosition;
+  }
+
+  size_t size() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return buffer.size();
+  }
+
+  long long getDroppedBytes() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return droppedBytes;
+  }
+
+  // Must be called only by the consumer thread.
+  // Calls `write(type, data, length)` for buffered output before position `upTo`, runs of the same type are not split
+  template <typename Write>
+  void drain(uint64_t upTo, Write const& write) {
+    while (true) {
+      if (takenOffset == taken.size() && !takeBuffer()) return;
+      while (takenRun < takenRuns.size()) {
+        Run const& run = takenRuns[takenRun];
+        uint64_t end = std::min(run.end, upTo);
+        if (end <= takenStart + takenOffset) return;
+        size_t endOffset = (size_t)(end - takenStart);
+        write(run.type, taken.data() + takenOffset, endOffset - takenOffset);
+        takenOffset = endOffset;
+        if (end != run.end) return;
+        ++takenRun;
+      }
+    }
+  }
+
+private:
+  struct Run {
+    int type;
+    uint64_t end; // Position after the last byte of the run
+  };
+
+  bool takeBuffer() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (buffer.empty()) return false;
+    taken.clear();
+    takenRuns.clear();
+    taken.swap(buffer);
+    takenRuns.swap(runs);
+    takenStart = endPosition - taken.size();
+    takenOffset = 0;
+    takenRun = 0;
+    condVar.notify_all();
+    return true;
+  }
+
+  size_t capacity;
+  size_t flushThreshold;
+  std::function<void()> onThreshold;
+  OverflowPolicy policy = OverflowPolicy::GROW;
+
+  std::mutex mutex;
+  std::condition_variable condVar;
+  std::string buffer;
+  std::vector<Run> runs;
+  uint64_t endPosition = 0;
+  long long droppedBytes = 0;
+
+  // Consumer side
+  std::string taken;
+  std::vector<Run> takenRuns;
+  uint64_t takenStart = 0;
+  size_t takenOffset = 0;
+  size_t takenRun = 0;
+};
+
+#endif //RWRAPPER_OUTPUT_ARENA_H
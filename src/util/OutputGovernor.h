@@ -0,0 +1,181 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_OUTPUT_GOVERNOR_H
+#define RWRAPPER_OUTPUT_GOVERNOR_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <string>
+#include <utility>
+#include "StringUtil.h"
+
+const int MIN_OUTPUT_FLUSH_INTERVAL_MS = 20;
+const int MAX_OUTPUT_FLUSH_INTERVAL_MS = 1000;
+const size_t MAX_SPILL_FILES = 8;
+
+// Limits console output sent to the client during one session (from a command to the next prompt).
+// The first `budget` bytes are sent as is, followed by a notice. After that the output is written to a spill file
+// and only the last `tailSize` bytes are kept; they are sent at the end of the session after the total size.
+// Only the last MAX_SPILL_FILES spill files are kept, all of them are removed with the governor.
+// Output is cut only at UTF-8 character boundaries.
+// Also adapts the flush interval to the time the client takes to receive a message.
+class OutputGovernor {
+public:
+  typedef std::function<void(int type, const char* data, size_t length)> Writer;
+
+  OutputGovernor(size_t budget, size_t tailSize, int markerType, Writer writer)
+    : budget(budget), tailSize(tailSize), markerType(markerType), writer(std::move(writer)) {
+  }
+
+  ~OutputGovernor() {
+    if (spillFile != nullptr) fclose(spillFile);
+    for (auto const& path : spillPaths) remove(path.c_str());
+  }
+
+  OutputGovernor(OutputGovernor const&) = delete;
+  OutputGovernor& operator = (OutputGovernor const&) = delete;
+
+  void write(int type, const char* data, size_t length) {
+    if (budget == 0 || (!isOverflow && sent + length <= budget)) {
+      send(type, data, length);
+      sent += length;
+      return;
+    }
+    if (!isOverflow) {
+      size_t head = utf8BoundaryBefore(data, length, budget - sent);
+      send(type, data, head);
+      sent += head;
+      data += head;
+      length -= head;
+      startOverflow();
+    }
+    spill(type, data, length);
+  }
+
+  // Sends the tail of the truncated output, the next session gets a fresh budget
+  void endSession() {
+    if (isOverflow) {
+      if (spillFile != nullptr) {
+        fclose(spillFile);
+        spillFile = nullptr;
+      }
+      std::string marker = "\n[" + std::to_string(spilled) + " bytes of output were " +
+          (spillPath.empty() ? std::string("discarded") : "written to " + spillPath) + ", the end follows]\n";
+      send(markerType, marker.c_str(), marker.size());
+      for (auto const& chunk : tail) send(chunk.first, chunk.second.c_str(), chunk.second.size());
+      tail.clear();
+      tailLength = 0;
+      spilled = 0;
+      isOverflow = false;
+    }
+    sent = 0;
+  }
+
+  std::chrono::milliseconds flushInterval() const {
+    return interval;
+  }
+
+private:
+  void send(int type, const char* data, size_t length) {
+    if (length == 0) return;
+    auto start = std::chrono::steady_clock::now();
+    writer(type, data, length);
+    // A slow client makes writes block, then longer intervals give larger and fewer messages
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    auto target = (interval * 3 + duration * 4) / 4;
+    interval = std::min(std::chrono::milliseconds(MAX_OUTPUT_FLUSH_INTERVAL_MS),
+                        std::max(std::chrono::milliseconds(MIN_OUTPUT_FLUSH_INTERVAL_MS), target));
+  }
+
+  void startOverflow() {
+    isOverflow = true;
+    static int counter = 0;
+    const char* directory = nullptr;
+    for (const char* name : {"TMPDIR", "TMP", "TEMP"}) {
+      directory = getenv(name);
+      if (directory != nullptr && *directory != 0) break;
+    }
+    spillPath = std::string(directory != nullptr && *directory != 0 ? directory : "/tmp") + "/rwrapper-output-" +
+        std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + "-" +
+        std::to_string(++counter) + ".txt";
+    spillFile = fopen(spillPath.c_str(), "wb");
+    if (spillFile == nullptr) {
+      spillPath.clear();
+    } else {
+      spillPaths.push_back(spillPath);
+      if (spillPaths.size() > MAX_SPILL_FILES) {
+        remove(spillPaths.front().c_str());
+        spillPaths.pop_front();
+      }
+    }
+    // Without the notice the console would just stop until the command finishes
+    std::string marker = "\n[Output truncated: " + (spillPath.empty() ? std::string("the rest is discarded") :
+        "the rest is written to " + spillPath) + ", its end will be shown when the command finishes]\n";
+    send(markerType, marker.c_str(), marker.size());
+  }
+
+  void spill(int type, const char* data, size_t length) {
+    if (spillFile != nullptr) fwrite(data, 1, length, spillFile);
+    spilled += length;
+    if (length >= tailSize) {
+      size_t start = utf8BoundaryAfter(data, length, length - tailSize);
+      tail.clear();
+      tail.emplace_back(type, std::string(data + start, length - start));
+      tailLength = length - start;
+      return;
+    }
+    if (!tail.empty() && tail.back().first == type) {
+      tail.back().second.append(data, length);
+    } else {
+      tail.emplace_back(type, std::string(data, length));
+    }
+    tailLength += length;
+    while (tailLength > tailSize) {
+      std::string &front = tail.front().second;
+      size_t extra = utf8BoundaryAfter(front.data(), front.size(), tailLength - tailSize);
+      if (front.size() <= extra) {
+        tailLength -= front.size();
+        tail.pop_front();
+      } else {
+        front.erase(0, extra);
+        tailLength -= extra;
+      }
+    }
+  }
+
+  size_t budget;
+  size_t tailSize;
+  int markerType;
+  Writer writer;
+  std::chrono::milliseconds interval = std::chrono::milliseconds(60);
+
+  size_t sent = 0;
+  bool isOverflow = false;
+  std::string spillPath;
+  std::deque<std::string> spillPaths;
+  FILE* spillFile = nullptr;
+  size_t spilled = 0;
+  std::deque<std::pair<int, std::string>> tail;
+  size_t tailLength = 0;
+};
+
+#endif //RWRAPPER_OUTPUT_GOVERNOR_H
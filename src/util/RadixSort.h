@@ -0,0 +1,78 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_RADIX_SORT_H
+#define RWRAPPER_RADIX_SORT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Stable LSD radix sort of `index` by unsigned keys `key(index[i])`.
+// Byte positions where all keys are equal are skipped.
+// Sorting by several keys is done by calling it for each key, starting from the least significant one.
+template <typename Key, typename KeyFunction>
+void radixSort(std::vector<int> &index, std::vector<int> &buffer, KeyFunction const& key) {
+  constexpr int BYTES = sizeof(Key);
+  size_t n = index.size();
+  if (n < 2) return;
+  std::vector<std::array<size_t, 256>> counts(BYTES);
+  for (size_t i = 0; i < n; ++i) {
+    Key k = key(index[i]);
+    for (int b = 0; b < BYTES; ++b) {
+      ++counts[b][(k >> (8 * b)) & 0xFF];
+    }
+  }
+  buffer.resize(n);
+  Key firstKey = key(index[0]);
+  for (int b = 0; b < BYTES; ++b) {
+    auto &count = counts[b];
+    if (count[(firstKey >> (8 * b)) & 0xFF] == n) continue;
+    size_t sum = 0;
+    for (size_t &c : count) {
+      size_t current = c;
+      c = sum;
+      sum += current;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      int x = index[i];
+      buffer[count[(key(x) >> (8 * b)) & 0xFF]++] = x;
+    }
+    index.swap(buffer);
+  }
+}
+
+// Order-preserving mapping of int to unsigned key, NA (INT_MIN) is placed after all other values
+inline uint32_t intSortKey(int x, bool descending) {
+  if (x == INT32_MIN) return UINT32_MAX;
+  uint32_t k = ((uint32_t)x ^ 0x80000000u) - 1;
+  return descending ? UINT32_MAX - 1 - k : k;
+}
+
+// Order-preserving mapping of double to unsigned key, NA and NaN are placed after all other values
+inline uint64_t doubleSortKey(double x, bool descending) {
+  if (x != x) return UINT64_MAX;
+  if (x == 0) x = 0; // -0.0 and 0.0 are equal
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  uint64_t k = (bits & 0x8000000000000000ull) ? ~bits : (bits | 0x8000000000000000ull);
+  return descending ? ~k : k;
+}
+
+#endif //RWRAPPER_RADIX_SORT_H
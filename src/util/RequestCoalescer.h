@@ -0,0 +1,106 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_REQUEST_COALESCER_H
+#define RWRAPPER_REQUEST_COALESCER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Lets concurrent identical requests share one computation:
+// the first one computes the response, the others wait for it and get a copy
+template <typename Response>
+class RequestCoalescer {
+public:
+  // `compute` returns false if the response is incomplete (e.g. its request was cancelled),
+  // then the waiting requests compute it themselves.
+  // Returns false if `isCancelled()` became true while waiting, call `wakeWaiters` to make them recheck it.
+  bool execute(std::string const& key, Response* response, std::function<bool(Response*)> const& compute,
+               std::function<bool()> const& isCancelled) {
+    std::shared_ptr<Flight> flight;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        auto it = flights.find(key);
+        if (it == flights.end()) break;
+        std::shared_ptr<Flight> other = it->second;
+        ++other->waiters;
+        condVar.wait(lock, [&] { return other->done || isCancelled(); });
+        --other->waiters;
+        if (!other->done) return false;
+        if (other->isComplete) {
+          *response = other->response;
+          sharedCount.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+      }
+      flight = std::make_shared<Flight>();
+      flights.emplace(key, flight);
+    }
+    bool isComplete = false;
+    try {
+      isComplete = compute(response);
+    } catch (...) {
+      finish(key, flight, nullptr);
+      throw;
+    }
+    finish(key, flight, isComplete ? response : nullptr);
+    return true;
+  }
+
+  void wakeWaiters() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condVar.notify_all();
+  }
+
+  // Number of requests answered with a copy of another one's response
+  long long getSharedCount() const {
+    return sharedCount.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Flight {
+    bool done = false;
+    bool isComplete = false;
+    int waiters = 0;
+    Response response;
+  };
+
+  void finish(std::string const& key, std::shared_ptr<Flight> const& flight, Response const* response) {
+    std::unique_lock<std::mutex> lock(mutex);
+    flights.erase(key);
+    flight->done = true;
+    // Nobody needs a copy if nobody is waiting, new requests start their own computation
+    if (response != nullptr && flight->waiters > 0) {
+      flight->response = *response;
+      flight->isComplete = true;
+    }
+    condVar.notify_all();
+  }
+
+  std::mutex mutex;
+  std::condition_variable condVar;
+  std::unordered_map<std::string, std::shared_ptr<Flight>> flights;
+  std::atomic<long long> sharedCount{0};
+};
+
+#endif //RWRAPPER_REQUEST_COALESCER_H
@@ -19,6 +19,7 @@
 #define RWRAPPER_STRING_UTIL_H
 
 #include <string>
+#include <cstdint>
 #include <cstring>
 #include <vector>
 #include <sstream>
@@ -152,4 +153,24 @@ inline void fixUTF8Tail(std::string &s) {
    s.erase(s.begin() + pos, s.end());
 }
 
+inline bool isUTF8Continuation(char c) {
+  return ((uint8_t)c >> 6) == 2;
+}
+
+// Nearest position not after `pos` that doesn't split a UTF-8 sequence, for cutting text into valid pieces.
+// Invalid sequences are cut at `pos` as is
+inline size_t utf8BoundaryBefore(const char* s, size_t length, size_t pos) {
+  if (pos >= length) return length;
+  size_t result = pos;
+  while (result > 0 && pos - result < 3 && isUTF8Continuation(s[result])) --result;
+  return isUTF8Continuation(s[result]) ? pos : result;
+}
+
+// Nearest position not before `pos` that doesn't split a UTF-8 sequence
+inline size_t utf8BoundaryAfter(const char* s, size_t length, size_t pos) {
+  size_t result = pos;
+  while (result < length && result - pos < 3 && isUTF8Continuation(s[result])) ++result;
+  return result < length && isUTF8Continuation(s[result]) ? pos : result;
+}
+
 #endif //RWRAPPER_STRING_UTIL_H
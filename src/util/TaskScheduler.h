@@ -0,0 +1,150 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_TASK_SCHEDULER_H
+#define RWRAPPER_TASK_SCHEDULER_H
+
+#include "LatencyHistogram.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class TaskPriority {
+  INTERACTIVE = 0, // REPL input, interrupts and debugger commands
+  UI = 1,          // Requests from IDE views
+  BACKGROUND = 2   // Work that nobody waits for
+};
+
+const int TASK_PRIORITY_COUNT = 3;
+
+struct TaskOptions {
+  TaskOptions(TaskPriority priority = TaskPriority::UI) : priority(priority) {}
+
+  TaskPriority priority;
+  // The task is dropped if it hasn't started before the deadline
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+  // A new task with the same key drops the pending one
+  std::string supersedeKey;
+  // Called instead of the task when it is dropped
+  std::function<void()> onDrop;
+};
+
+// Queue of tasks with several priority classes, FIFO within a class
+class TaskScheduler {
+public:
+  // Returns an id for `cancel`
+  uint64_t push(std::function<void()> const& f, TaskOptions const& options) {
+    std::function<void()> onDrop;
+    uint64_t id;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      id = ++lastId;
+      if (!options.supersedeKey.empty()) {
+        auto it = pendingKeys.find(options.supersedeKey);
+        if (it != pendingKeys.end()) removePending(it->second, onDrop);
+        pendingKeys[options.supersedeKey] = id;
+      }
+      queues[(int)options.priority].push_back({f, options, std::chrono::steady_clock::now(), id});
+    }
+    if (onDrop) onDrop();
+    return id;
+  }
+
+  bool poll(std::function<void()> &f) {
+    std::vector<std::function<void()>> dropped;
+    bool found = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      auto now = std::chrono::steady_clock::now();
+      for (int priority = 0; priority < TASK_PRIORITY_COUNT && !found; ++priority) {
+        auto &queue = queues[priority];
+        while (!queue.empty() && !found) {
+          Task task = std::move(queue.front());
+          queue.pop_front();
+          if (!task.options.supersedeKey.empty()) pendingKeys.erase(task.options.supersedeKey);
+          if (now > task.options.deadline) {
+            droppedCounts[priority].fetch_add(1, std::memory_order_relaxed);
+            if (task.options.onDrop) dropped.push_back(std::move(task.options.onDrop));
+            continue;
+          }
+          waitTimes[priority].add(now - task.queuedAt);
+          f = std::move(task.f);
+          found = true;
+        }
+      }
+    }
+    for (auto const& onDrop : dropped) onDrop();
+    return found;
+  }
+
+  // Removes the task if it hasn't started yet, its onDrop is not called
+  bool cancel(uint64_t id) {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::function<void()> onDrop;
+    return removePending(id, onDrop);
+  }
+
+  // Time from scheduling a task to its start
+  LatencyHistogram const& getWaitTimes(TaskPriority priority) const {
+    return waitTimes[(int)priority];
+  }
+
+  long long getDroppedCount(TaskPriority priority) const {
+    return droppedCounts[(int)priority].load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Task {
+    std::function<void()> f;
+    TaskOptions options;
+    std::chrono::steady_clock::time_point queuedAt;
+    uint64_t id;
+  };
+
+  bool removePending(uint64_t id, std::function<void()> &onDrop) {
+    for (int priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+      auto &queue = queues[priority];
+      for (auto it = queue.begin(); it != queue.end(); ++it) {
+        if (it->id != id) continue;
+        onDrop = std::move(it->options.onDrop);
+        if (!it->options.supersedeKey.empty()) {
+          auto key = pendingKeys.find(it->options.supersedeKey);
+          if (key != pendingKeys.end() && key->second == id) pendingKeys.erase(key);
+        }
+        queue.erase(it);
+        droppedCounts[priority].fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::mutex mutex;
+  std::deque<Task> queues[TASK_PRIORITY_COUNT];
+  std::unordered_map<std::string, uint64_t> pendingKeys;
+  uint64_t lastId = 0;
+  LatencyHistogram waitTimes[TASK_PRIORITY_COUNT];
+  std::atomic<long long> droppedCounts[TASK_PRIORITY_COUNT] = {};
+};
+
+#endif //RWRAPPER_TASK_SCHEDULER_H